@@ -0,0 +1,152 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file cksum_bench.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Checksum microbenchmark: Compares the cksum() implementations supported
+   by this processor, from small headers to jumbo frames.
+
+   Usage: make bench && bin/cksum_bench */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <t50_cksum.h>
+
+#define MAX_SIZE  9000
+#define TOTAL     ( 256U << 20 )    /* Bytes summed, for each size. */
+#define BIG_SIZE  ( 8U << 20 )      /* Many SIMD blocks, for the checks. */
+
+static double now ( void )
+{
+  struct timespec ts;
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main ( void )
+{
+  static const size_t sizes[] = { 20, 40, 64, 128, 256, 576, 1500, 4096, 9000, 0 };
+  const cksum_impl_T *impls, *p;
+  const size_t *size;
+  unsigned char *buffer, *big;
+  volatile uint16_t sink;
+  unsigned long i, n;
+  size_t len, off;
+  double t;
+
+  if ( ! ( buffer = malloc ( MAX_SIZE + 1 ) ) || ! ( big = malloc ( BIG_SIZE + 1 ) ) )
+  {
+    fputs ( "Cannot allocate buffer.\n", stderr );
+    return EXIT_FAILURE;
+  }
+
+  i = 0;
+  while ( i < MAX_SIZE + 1 )
+    buffer[i++] = rand();
+
+  impls = get_cksum_impls();
+
+  /* All of them must agree with the scalar routine (any size and alignment). */
+  len = 0;
+  while ( len <= 300 )
+  {
+    off = 0;
+    while ( off < 2 )
+    {
+      p = impls + 1;
+      while ( p->name )
+      {
+        if ( p->func ( buffer + off, len ) != impls->func ( buffer + off, len ) )
+        {
+          fprintf ( stderr, "%s: wrong checksum (%zu bytes, offset %zu).\n", p->name, len, off );
+          return EXIT_FAILURE;
+        }
+
+        p++;
+      }
+
+      off++;
+    }
+
+    len++;
+  }
+
+  /* And on big buffers: Random bytes and all ones (the biggest sums,
+     where the SIMD lanes could overflow). */
+  off = 0;
+  while ( off < 2 )
+  {
+    i = 0;
+    while ( i < BIG_SIZE + 1 )
+      big[i++] = off ? 0xff : rand();
+
+    p = impls + 1;
+    while ( p->name )
+    {
+      if ( p->func ( big + 1, BIG_SIZE ) != impls->func ( big + 1, BIG_SIZE ) )
+      {
+        fprintf ( stderr, "%s: wrong checksum (%u bytes, %s).\n", p->name, BIG_SIZE,
+                  off ? "all ones" : "random" );
+        return EXIT_FAILURE;
+      }
+
+      p++;
+    }
+
+    off++;
+  }
+
+  free ( big );
+
+  printf ( "%6s", "bytes" );
+  p = impls;
+  while ( p->name )
+    printf ( " %20s", ( p++ )->name );
+  putchar ( '\n' );
+
+  size = sizes;
+  while ( *size )
+  {
+    n = TOTAL / *size;
+
+    printf ( "%6zu", *size );
+    p = impls;
+    while ( p->name )
+    {
+      t = now();
+
+      i = 0;
+      while ( i++ < n )
+        sink = p->func ( buffer, *size );
+
+      t = now() - t;
+      printf ( " %8.1f ns %6.2f GB/s", t * 1e9 / n, TOTAL / t * 1e-9 );
+      p++;
+    }
+    putchar ( '\n' );
+
+    size++;
+  }
+
+  ( void ) sink;
+  free ( buffer );
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file rng_bench.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Random number generators microbenchmark: Cost of each RANDOM() call,
+   for every --rng option (and for one xorshift128+ word per call, through a
+   function pointer, as RANDOM was before the pool).
+
+   Usage: make bench && bin/rng_bench */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <t50_randomizer.h>
+
+#define CALLS 50000000UL
+
+static double now ( void )
+{
+  struct timespec ts;
+
+  clock_gettime ( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t state[2] = { 1, 2 };
+
+static uint32_t xorshift ( void )
+{
+  uint64_t s0 = state[1];
+  uint64_t s1 = state[0];
+  state[0] = s0;
+
+  s1 ^= s1 << 23;
+  state[1] = s1 ^ s0 ^ ( s1 >> 18 ) ^ ( s0 >> 5 );
+
+  return ( state[1] + s0 );
+}
+
+/* Calls RANDOM() 'n' times (the sum keeps the compiler from discarding them). */
+static double time_random ( unsigned long n )
+{
+  volatile uint32_t sink;
+  uint32_t sum;
+  double t;
+
+  sum = 0;
+  t = now();
+
+  while ( n-- )
+    sum += RANDOM();
+
+  t = now() - t;
+  sink = sum;
+  ( void ) sink;
+
+  return t;
+}
+
+static double time_pointer ( unsigned long n )
+{
+  uint32_t ( * volatile func ) ( void ) = xorshift;
+  volatile uint32_t sink;
+  uint32_t sum;
+  double t;
+
+  sum = 0;
+  t = now();
+
+  while ( n-- )
+    sum += func();
+
+  t = now() - t;
+  sink = sum;
+  ( void ) sink;
+
+  return t;
+}
+
+int main ( void )
+{
+  unsigned long n;
+
+  SRANDOM ( 0, 0 );
+
+  select_rng ( RNG_XORSHIFT );
+  printf ( "%-22s %6.2f ns/call\n", "xorshift (pool)", time_random ( CALLS ) * 1e9 / CALLS );
+  printf ( "%-22s %6.2f ns/call\n", "xorshift (pointer)", time_pointer ( CALLS ) * 1e9 / CALLS );
+
+  if ( rdrand_supported() )
+  {
+    /* RDRAND is a lot slower. */
+    n = CALLS / 20;
+
+    select_rng ( RNG_RDRAND );
+    printf ( "%-22s %6.2f ns/call\n", "rdrand (pool)", time_random ( n ) * 1e9 / n );
+  }
+  else
+    printf ( "%-22s not supported\n", "rdrand" );
+
+  return EXIT_SUCCESS;
+}
@@ -27,17 +27,71 @@
 #include <t50_errors.h>
 
 static struct cidr cidr = {0};
+static struct cidr source_cidr = {0};
+
+/* Address sweep (--permute).
+
+   Host indexes (0 to hostid) are mapped to host offsets by a keyed
+   permutation: an unbalanced Feistel network over the smallest power of
+   two holding all of them (lo and hi halves, xored alternately), with
+   "cycle walking" to skip the values out of range (less than 2 steps,
+   on average). All workers use the same key (from the seed), and each one
+   walks its own slice of indexes, so every host is visited exactly once
+   per cycle. Destination and source CIDRs have their own keys. */
+
+/* Murmur3 finalizer (keys derivation). */
+static uint32_t mix32 ( uint32_t x )
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6bU;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35U;
+  x ^= x >> 16;
+
+  return x;
+}
+
+static uint32_t feistel ( const struct cidr * const c, uint32_t x )
+{
+  uint32_t lo, hi, lo_mask, hi_mask, f;
+  int i;
+
+  lo_mask = ( 1U << c->lo_bits ) - 1;
+  hi_mask = ( 1U << c->hi_bits ) - 1;
+  lo = x & lo_mask;
+  hi = x >> c->lo_bits;
+
+  i = 0;
+  while ( i < SWEEP_ROUNDS )
+  {
+    f = ( ( i & 1 ? hi : lo ) ^ c->keys[i] ) * 0x9e3779b1U;
+    f ^= f >> 15;
+
+    if ( i & 1 )
+      lo ^= f & lo_mask;
+    else
+      hi ^= f & hi_mask;
+
+    i++;
+  }
+
+  return hi << c->lo_bits | lo;
+}
 
 /**
  * CIDR configuration tiny C algorithm.
  *
  * This will setup cidr structure with values in host order.
  *
+ * @param c Pointer to cidr structure.
  * @param bits Number of "valid" bits on netmask.
  * @param address IP address from command line (in network order).
+ * @param permute Setup the permutation of the hosts (--permute).
+ * @param key Permutation key.
  * @return Pointer to cidr structure.
  */
-struct cidr *config_cidr ( const config_options_T * const co )
+static struct cidr *setup_cidr ( struct cidr *c, uint32_t bits, in_addr_t address,
+                                 _Bool permute, uint64_t key )
 {
   /*
    * nbrito -- Thu Dec 23 13:06:39 BRST 2010
@@ -67,31 +121,124 @@ struct cidr *config_cidr ( const config_options_T * const co )
    */
 
   // FIXME: Is this condition is really necessary?
-  if ( co->bits < CIDR_MAXIMUM )
+  // NOTE: bits is 0 if there is no address (--targets) or no CIDR.
+  if ( bits && bits < CIDR_MAXIMUM )
   {
     uint32_t netmask;
 
-    cidr.hostid = ( 1U << ( 32 - co->bits ) ) - 2U;
+    c->hostid = ( 1U << ( 32 - bits ) ) - 2U;
 
     /* XXX Sanitizing the maximum host identifier's IP addresses.
      * XXX Should never reaches here!!! */
-    if ( cidr.hostid > MAXIMUM_IP_ADDRESSES )
+    if ( c->hostid > MAXIMUM_IP_ADDRESSES )
     {
       error ( "internal error detecded -- please, report.\n"
               "cidr.hostid (%u) > MAXIMUM_IP_ADDRESSES (%u): Probably a specific platform error.",
-              cidr.hostid, MAXIMUM_IP_ADDRESSES );
+              c->hostid, MAXIMUM_IP_ADDRESSES );
 
       return NULL;
     }
 
-    netmask = ~( ~0U >> co->bits );
-    cidr.__1st_addr = ( ntohl ( co->ip.daddr ) & netmask ) + 1; // avoid bit 0 = 0.
+    netmask = ~( ~0U >> bits );
+    c->__1st_addr = ( ntohl ( address ) & netmask ) + 1; // avoid bit 0 = 0.
   }
   else
   {
-    cidr.hostid = 0;    // means "not random address".
-    cidr.__1st_addr = ntohl ( co->ip.daddr );
+    c->hostid = 0;    // means "not random address".
+    c->__1st_addr = ntohl ( address );
+  }
+
+  /* The permutation of the hosts (--permute). */
+  if ( permute && c->hostid )
+  {
+    unsigned int width, i;
+
+    /* Bits needed to hold hostid (at least 1 on each half). */
+    width = 32 - __builtin_clz ( c->hostid );
+    if ( width < 2 )
+      width = 2;
+
+    c->lo_bits = width / 2;
+    c->hi_bits = width - c->lo_bits;
+
+    i = 0;
+    while ( i < SWEEP_ROUNDS )
+    {
+      c->keys[i] = mix32 ( ( uint32_t ) key + i * 0x9e3779b9U ) ^
+                   mix32 ( key >> 32 );
+      i++;
+    }
+  }
+
+  return c;
+}
+
+/* Destination addresses. */
+struct cidr *config_cidr ( const config_options_T * const co )
+{
+  return setup_cidr ( &cidr, co->bits, co->ip.daddr, co->permute, co->seed );
+}
+
+/* Source addresses (--saddr with a CIDR). */
+struct cidr *config_source_cidr ( const config_options_T * const co )
+{
+  return setup_cidr ( &source_cidr, co->sbits, co->ip.saddr, co->permute,
+                      co->seed ^ 0x5bd1e9955bd1e995ULL );
+}
+
+/**
+ * Selects the slice of host indexes swept by a worker (--permute).
+ *
+ * Hosts are split as the packets are (see run_workers()), so a threshold
+ * equal to the number of hosts sends exactly one packet to each of them.
+ *
+ * @param cidr_ptr Pointer to cidr structure.
+ * @param sweep Pointer to the worker sweep.
+ * @param worker Worker index.
+ * @param num_workers Number of workers.
+ */
+void init_sweep ( const struct cidr * const cidr_ptr, sweep_T *sweep,
+                  unsigned int worker, unsigned int num_workers )
+{
+  uint32_t hosts, n, r;
+
+  hosts = cidr_ptr->hostid + 1;
+  n = hosts / num_workers;
+  r = hosts % num_workers;
+
+  sweep->start = worker * n + ( worker < r ? worker : r );
+  sweep->end = sweep->start + n + ( worker < r );
+
+  /* More workers than hosts? Sweep all of them. */
+  if ( sweep->start == sweep->end )
+  {
+    sweep->start = 0;
+    sweep->end = hosts;
   }
 
-  return &cidr;
+  sweep->next = sweep->start;
+}
+
+/**
+ * Gets the next host (offset from the first address) of the worker slice.
+ *
+ * @param cidr_ptr Pointer to cidr structure.
+ * @param sweep Pointer to the worker sweep.
+ * @return Host offset (0 to hostid).
+ */
+uint32_t next_host ( const struct cidr * const cidr_ptr, sweep_T *sweep )
+{
+  uint32_t x;
+
+  x = sweep->next;
+  if ( ++sweep->next == sweep->end )
+    sweep->next = sweep->start;
+
+  /* Cycle walking: the permutation of a value in range may be out of it.
+     Applied again, it must get back in range (it is a cycle). */
+  do
+    x = feistel ( cidr_ptr, x );
+  while ( x > cidr_ptr->hostid );
+
+  return x;
 }
@@ -19,45 +19,310 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+#include <t50_defines.h>
 #include <t50_cksum.h>
 
-/**
- * Calculates checksum.
- *
- * RFC 1071 compliant checksum routine.
- *
- * FIXED: last implementation was WRONG... I can't find any faster way to do this!
- *        Yet... There was another error that didn't consider BIG ENDIAN machines...
- *        Note to myself: Don't mess with this routine again!
- *
- *        That being said, I shold find a way to calculate the checksum faster.
- */
-uint16_t cksum ( void *data, size_t length )
+#if defined(__i386) || defined(__x86_64)
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* RFC 1071 compliant checksum routines.
+
+   All of them sum the data in 32 bits words on a 64 bits accumulator (as
+   in RFC 1071, section 2: the sum is independent of the word size and of
+   the byte order), folded to 16 bits in the end. The SIMD ones sum 16 or
+   32 bytes at a time and leave the remaining bytes to cksum_tail().
+
+   NOTE: Like the old cksum(), the result is in the order the words are
+         read from memory. Let the caller put it in network order, if
+         necessary! */
+
+/* Sums the remaining bytes and folds the sum. */
+static uint16_t cksum_tail ( uint64_t sum, const void *p, size_t length )
 {
-  uint16_t *ptr;
-  uint32_t sum;
+  uint32_t w;
+  uint16_t h;
 
-  sum = 0;
-  ptr = data;  
-  while ( length > 1 )
+  while ( length >= 4 )
   {
-    sum += *ptr++;
+    memcpy ( &w, p, 4 );
+    sum += w;
+    p += 4;
+    length -= 4;
+  }
+
+  if ( length >= 2 )
+  {
+    memcpy ( &h, p, 2 );
+    sum += h;
+    p += 2;
     length -= 2;
   }
 
   // if there is any additional bytes remaining...
   if ( length > 0 )
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-   sum += (uint16_t)(*(uint8_t *)ptr) << 8;   // last byte must be
-                                              // aligned to upper 8 bits.
+    sum += ( uint16_t ) ( * ( uint8_t * ) p ) << 8; // last byte must be
+                                                    // aligned to upper 8 bits.
 #else
-   sum += *(uint8_t *)ptr;
+    sum += * ( uint8_t * ) p;
 #endif
 
   // Add carry-outs...
+  sum = ( sum & 0xffffffffU ) + ( sum >> 32 );
+  sum = ( sum & 0xffffffffU ) + ( sum >> 32 );
+
   while ( sum >> 16 )
     sum = ( sum & 0xffffU ) + ( sum >> 16 );
 
-  // NOTE: Let the caller put this in network order, if necessary!
+  return ~sum;
+}
+
+static uint16_t cksum_scalar ( void *data, size_t length )
+{
+  return cksum_tail ( 0, data, length );
+}
+
+#if defined(__i386) || defined(__x86_64)
+/* Each 32 bits word is split in its 16 bits halves (w & 0xffff, w >> 16),
+   summed on 32 bits lanes (no shuffles needed). Two vectors per iteration,
+   on independent lanes. The lanes are added to the 64 bits sum before they
+   can overflow: The 4 accumulators are added together first, so each
+   block is, at most, 16384 iterations (4 * 0xffff * 16384 < 2^32). */
+#define SIMD_BLOCK 16384
+
+__attribute__ ( ( target ( "sse2" ) ) )
+static uint16_t cksum_sse2 ( void *data, size_t length )
+{
+  __m128i mask, lo0, hi0, lo1, hi1, v0, v1;
+  uint32_t s[4];
+  uint64_t sum;
+  size_t n;
+  void *p;
+
+  p = data;
+  sum = 0;
+  mask = _mm_set1_epi32 ( 0xffff );
+
+  while ( length >= 32 )
+  {
+    n = length / 32;
+    if ( n > SIMD_BLOCK )
+      n = SIMD_BLOCK;
+    length -= n * 32;
+
+    lo0 = hi0 = lo1 = hi1 = _mm_setzero_si128();
+    while ( n-- )
+    {
+      v0 = _mm_loadu_si128 ( p );
+      v1 = _mm_loadu_si128 ( p + 16 );
+      lo0 = _mm_add_epi32 ( lo0, _mm_and_si128 ( v0, mask ) );
+      hi0 = _mm_add_epi32 ( hi0, _mm_srli_epi32 ( v0, 16 ) );
+      lo1 = _mm_add_epi32 ( lo1, _mm_and_si128 ( v1, mask ) );
+      hi1 = _mm_add_epi32 ( hi1, _mm_srli_epi32 ( v1, 16 ) );
+      p += 32;
+    }
+
+    _mm_storeu_si128 ( ( __m128i * ) s,
+                       _mm_add_epi32 ( _mm_add_epi32 ( lo0, hi0 ), _mm_add_epi32 ( lo1, hi1 ) ) );
+    sum += ( uint64_t ) s[0] + s[1] + s[2] + s[3];
+  }
+
+  return cksum_tail ( sum, p, length );
+}
+
+__attribute__ ( ( target ( "avx2" ) ) )
+static uint16_t cksum_avx2 ( void *data, size_t length )
+{
+  __m256i mask, lo0, hi0, lo1, hi1, v0, v1;
+  uint32_t s[8];
+  uint64_t sum;
+  size_t n;
+  void *p;
+
+  p = data;
+  sum = 0;
+  mask = _mm256_set1_epi32 ( 0xffff );
+
+  while ( length >= 64 )
+  {
+    n = length / 64;
+    if ( n > SIMD_BLOCK )
+      n = SIMD_BLOCK;
+    length -= n * 64;
+
+    lo0 = hi0 = lo1 = hi1 = _mm256_setzero_si256();
+    while ( n-- )
+    {
+      v0 = _mm256_loadu_si256 ( p );
+      v1 = _mm256_loadu_si256 ( p + 32 );
+      lo0 = _mm256_add_epi32 ( lo0, _mm256_and_si256 ( v0, mask ) );
+      hi0 = _mm256_add_epi32 ( hi0, _mm256_srli_epi32 ( v0, 16 ) );
+      lo1 = _mm256_add_epi32 ( lo1, _mm256_and_si256 ( v1, mask ) );
+      hi1 = _mm256_add_epi32 ( hi1, _mm256_srli_epi32 ( v1, 16 ) );
+      p += 64;
+    }
+
+    _mm256_storeu_si256 ( ( __m256i * ) s,
+                          _mm256_add_epi32 ( _mm256_add_epi32 ( lo0, hi0 ), _mm256_add_epi32 ( lo1, hi1 ) ) );
+    sum += ( uint64_t ) s[0] + s[1] + s[2] + s[3] + s[4] + s[5] + s[6] + s[7];
+  }
+
+  return cksum_tail ( sum, p, length );
+}
+
+__attribute__ ( ( target ( "avx512f" ) ) )
+static uint16_t cksum_avx512 ( void *data, size_t length )
+{
+  __m512i mask, lo0, hi0, lo1, hi1, v0, v1;
+  uint32_t s[16];
+  uint64_t sum;
+  size_t n;
+  void *p;
+
+  p = data;
+  sum = 0;
+  mask = _mm512_set1_epi32 ( 0xffff );
+
+  while ( length >= 128 )
+  {
+    n = length / 128;
+    if ( n > SIMD_BLOCK )
+      n = SIMD_BLOCK;
+    length -= n * 128;
+
+    lo0 = hi0 = lo1 = hi1 = _mm512_setzero_si512();
+    while ( n-- )
+    {
+      v0 = _mm512_loadu_si512 ( p );
+      v1 = _mm512_loadu_si512 ( p + 64 );
+      lo0 = _mm512_add_epi32 ( lo0, _mm512_and_si512 ( v0, mask ) );
+      hi0 = _mm512_add_epi32 ( hi0, _mm512_srli_epi32 ( v0, 16 ) );
+      lo1 = _mm512_add_epi32 ( lo1, _mm512_and_si512 ( v1, mask ) );
+      hi1 = _mm512_add_epi32 ( hi1, _mm512_srli_epi32 ( v1, 16 ) );
+      p += 128;
+    }
+
+    _mm512_storeu_si512 ( s, _mm512_add_epi32 ( _mm512_add_epi32 ( lo0, hi0 ), _mm512_add_epi32 ( lo1, hi1 ) ) );
+    sum += ( uint64_t ) s[0] + s[1] + s[2] + s[3] + s[4] + s[5] + s[6] + s[7] +
+           s[8] + s[9] + s[10] + s[11] + s[12] + s[13] + s[14] + s[15];
+  }
+
+  return cksum_tail ( sum, p, length );
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+/* Pairs of 32 bits words are added to the 64 bits lanes (VPADAL). */
+static uint16_t cksum_neon ( void *data, size_t length )
+{
+  uint64x2_t sum0, sum1;
+  void *p;
+
+  p = data;
+  sum0 = sum1 = vdupq_n_u64 ( 0 );
+
+  while ( length >= 32 )
+  {
+    sum0 = vpadalq_u32 ( sum0, vreinterpretq_u32_u8 ( vld1q_u8 ( p ) ) );
+    sum1 = vpadalq_u32 ( sum1, vreinterpretq_u32_u8 ( vld1q_u8 ( p + 16 ) ) );
+    p += 32;
+    length -= 32;
+  }
+
+  sum0 = vaddq_u64 ( sum0, sum1 );
+
+  return cksum_tail ( vgetq_lane_u64 ( sum0, 0 ) + vgetq_lane_u64 ( sum0, 1 ), p, length );
+}
+#endif
+
+/* Implementations supported by this processor (the best one is the last).
+   Filled by the "constructor" below. */
+static cksum_impl_T impls[5] = { { "scalar", cksum_scalar } };
+
+/* The "constructor" below will overide this with the best implementation. */
+uint16_t ( *cksum ) ( void *, size_t ) = cksum_scalar;
+
+/**
+ * Gets the checksum implementations supported by this processor.
+ *
+ * @return Array terminated by an entry with a NULL name.
+ */
+const cksum_impl_T *get_cksum_impls ( void )
+{
+  return impls;
+}
+
+//--- Select the checksum routine (like check_rdrand() does for RANDOM).
+static void _INIT check_simd ( void )
+{
+  cksum_impl_T *p;
+#if defined(__i386) || defined(__x86_64)
+  unsigned int a, b, c, d, lo, hi;
+#endif
+
+  p = impls + 1;
+
+#if defined(__i386) || defined(__x86_64)
+  if ( __get_cpuid ( 1, &a, &b, &c, &d ) && ( d & bit_SSE2 ) )
+  {
+    *p++ = ( cksum_impl_T ) { "sse2", cksum_sse2 };
+
+    /* AVX2 and AVX-512 need the YMM/ZMM registers enabled by the OS, as well. */
+    if ( ( c & bit_OSXSAVE ) && ( c & bit_AVX ) )
+    {
+      __asm__ __volatile__ ( "xgetbv" : "=a" ( lo ), "=d" ( hi ) : "c" ( 0 ) );
+
+      if ( ( lo & 6 ) == 6 &&
+           __get_cpuid_count ( 7, 0, &a, &b, &c, &d ) && ( b & bit_AVX2 ) )
+      {
+        *p++ = ( cksum_impl_T ) { "avx2", cksum_avx2 };
+
+        if ( ( lo & 0xe6 ) == 0xe6 && ( b & bit_AVX512F ) )
+          *p++ = ( cksum_impl_T ) { "avx512", cksum_avx512 };
+      }
+    }
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  *p++ = ( cksum_impl_T ) { "neon", cksum_neon };
+#endif
+
+  cksum = p[-1].func;
+}
+
+/**
+ * Incremental update (RFC 1624, eqn. 3): HC' = ~(~HC + ~m + m').
+ *
+ * The part which doesn't change (~HC and the ~m of every field) is summed
+ * only once: Start with cksum_base(HC) and add cksum_remove() for each old
+ * value. Then, for every packet, add the new values (m') and call
+ * cksum_finish().
+ *
+ * NOTE: Fields must be word aligned on the checksummed block and all values
+ *       are in the same byte order used by cksum() (the order the words are
+ *       read from memory).
+ */
+uint32_t cksum_base ( uint16_t check )
+{
+  return ( uint16_t ) ~check;
+}
+
+uint32_t cksum_remove ( uint32_t sum, uint32_t old, unsigned int width )
+{
+  sum += ( uint16_t ) ~old;
+
+  if ( width == 4 )
+    sum += ( uint16_t ) ~( old >> 16 );
+
+  return sum;
+}
+
+uint16_t cksum_finish ( uint32_t sum )
+{
+  sum = ( sum & 0xffffU ) + ( sum >> 16 );
+  sum += sum >> 16;
+
   return ~sum;
 }
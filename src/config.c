@@ -20,12 +20,14 @@
 */
 
 #include <stdlib.h>
+#include <unistd.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <ctype.h>
 #include <setjmp.h>
 #include <limits.h>
 #include <regex.h>
@@ -46,6 +48,10 @@
 #include <t50_cidr.h>
 #include <t50_help.h>
 #include <t50_modules.h>
+#include <t50_backends.h>
+#include <t50_workers.h>
+#include <t50_randomizer.h>
+#include <t50_ports.h>
 
 /* Local prototypes. */
 static int                                check_if_option ( char * );
@@ -54,12 +60,20 @@ static void                               check_options_rules ( const config_opt
 _NOINLINE static struct options_table_s  *find_option ( char * );
 static void                               set_config_option ( config_options_T * restrict, char * restrict, int, char * restrict );
 _NOINLINE static uint32_t                 toULong ( char * restrict, char * restrict );
+static uint64_t                           toRate ( char * restrict, char * restrict );
+static uint64_t                           toULongLong ( char * restrict, char * restrict );
 _NOINLINE static uint32_t                 toULongCheckRange ( char * restrict, char * restrict, uint32_t, uint32_t );
 _NOINLINE static void                     check_list_separators ( char * restrict, char * restrict );
-static void                               set_destination_addresses ( char * restrict, config_options_T * restrict );
+static void                               set_addresses ( char * restrict, in_addr_t * restrict, uint32_t * restrict );
 static void                               list_protocols ( void );
 static void                               set_default_protocol ( config_options_T * );
 static void                               get_ip_protocol ( config_options_T * restrict, char * restrict );
+static void                               get_backend ( config_options_T * restrict, char * restrict );
+static void                               get_mac_address ( uint8_t * restrict, char * restrict, char * restrict );
+static void                               get_backpressure ( config_options_T * restrict, char * restrict );
+static void                               get_txtime ( config_options_T * restrict, char * restrict );
+static void                               get_rng ( config_options_T * restrict, char * restrict );
+static int                                get_port_mode ( char * restrict, char * restrict );
 static int                                get_ip_and_cidr_from_string ( char const * const, addr_T * );
 _NOINLINE static int                      get_dual_values ( char *, unsigned long *, unsigned long *, unsigned long, int, char, char * );
 static int                                check_threshold ( const config_options_T * const );
@@ -74,6 +88,15 @@ static config_options_T co =
 {
   /* XXX COMMON OPTIONS                                                         */
   .threshold = 1000,                  /* default threshold                      */
+  .batch = 1,                         /* default transmit batch (no batching)   */
+  .backend = BACKEND_RAW,             /* default transmit backend               */
+  .backpressure = BACKPRESSURE_POLL,  /* default: wait for room on the queue    */
+  .workers = 1,                       /* default number of workers              */
+  .builders = 1,                      /* default builders per worker (pipeline) */
+  .ring_depth = RING_DEPTH_DEFAULT,   /* default pipeline ring depth            */
+  .ring_slot = RING_SLOT_DEFAULT,     /* default pipeline ring slot size        */
+  .proto_run = 1,                     /* default: protocol changes every packet */
+  .dmac = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }, /* default: broadcast      */
 
   /* XXX IP HEADER OPTIONS  (IPPROTO_IP = 0)                                    */
   .ip = {
@@ -173,9 +196,34 @@ static struct options_table_s options[] =
 #endif
   { OPTION_THRESHOLD,               0,  "threshold",        1 },
   { OPTION_FLOOD,                   0,  "flood",            0 },
+  { OPTION_BATCH,                   0,  "batch",            1 },
+  { OPTION_BACKEND,                 0,  "backend",          1 },
+  { OPTION_IFACE,                   0,  "iface",            1 },
+  { OPTION_DMAC,                    0,  "dmac",             1 },
+  { OPTION_QDISC_BYPASS,            0,  "qdisc-bypass",     0 },
+  { OPTION_SQPOLL,                  0,  "sqpoll",           0 },
+  { OPTION_BACKPRESSURE,            0,  "backpressure",     1 },
+  { OPTION_WORKERS,                 0,  "workers",          1 },
+  { OPTION_CPUS,                    0,  "cpus",             1 },
+  { OPTION_PPS,                     0,  "pps",              1 },
+  { OPTION_BPS,                     0,  "bps",              1 },
+  { OPTION_TXTIME,                  0,  "txtime",           1 },
+  { OPTION_RNG,                     0,  "rng",              1 },
+  { OPTION_SEED,                    0,  "seed",             1 },
+  { OPTION_PERMUTE,                 0,  "permute",          0 },
+  { OPTION_TARGETS,                 0,  "targets",          1 },
+  { OPTION_SOURCES,                 0,  "sources",          1 },
+  { OPTION_SPORT_MODE,              0,  "sport-mode",       1 },
+  { OPTION_DPORT_MODE,              0,  "dport-mode",       1 },
+  { OPTION_PIPELINE,                0,  "pipeline",         0 },
+  { OPTION_BUILDERS,                0,  "builders",         1 },
+  { OPTION_RING_DEPTH,              0,  "ring-depth",       1 },
+  { OPTION_RING_SLOT,               0,  "ring-slot",        1 },
+  { OPTION_PREGEN,                  0,  "pregen",           1 },
   { OPTION_ENCAPSULATED,            0,  "encapsulated",     0 },
   { OPTION_BOGUSCSUM,             'B',  "bogus-csum",       0 },
   { OPTION_SHUFFLE,                 0,  "shuffle",          0 },
+  { OPTION_PROTO_RUN,               0,  "proto-run",        1 },
   { OPTION_QUIET,                 'q',  "quiet",            0 },
 
   /* XXX GRE HEADER OPTIONS (IPPROTO_GRE = 47) */
@@ -498,7 +546,7 @@ config_options_T *parse_command_line ( char **argv )
 
       dest_addr = *argv;
 
-      set_destination_addresses ( dest_addr, &co );
+      set_addresses ( dest_addr, &co.ip.daddr, &co.bits );
     }
 
     /* How many options we got so far? */
@@ -634,10 +682,13 @@ void check_options_rules ( const config_options_T *co )
 {
   struct options_table_s *ptbl;
 
-  /* Address field is mandatory! */
-  if ( !co->ip.daddr )
+  /* Address field (or a target list) is mandatory! */
+  if ( !co->ip.daddr && !co->targets )
     fatal_error ( "Target address needed." );
 
+  if ( co->ip.daddr && co->targets )
+    fatal_error ( "--targets cannot be used with a target address." );
+
 #ifdef __HAVE_TURBO__
 
   if ( co->turbo && !co->flood )
@@ -665,6 +716,80 @@ void check_options_rules ( const config_options_T *co )
     if ( check_threshold ( co ) )
       exit ( EXIT_FAILURE );
 
+  /* Link layer backends must know where to send the frames. */
+  if ( co->backend != BACKEND_RAW && co->backend != BACKEND_URING && !co->iface )
+    fatal_error ( "The %s backend needs an output interface (--iface).", backends_table[co->backend].name );
+
+  if ( co->qdisc_bypass && ( co->backend == BACKEND_RAW || co->backend == BACKEND_URING ) )
+    fatal_error ( "--qdisc-bypass is only available to link layer backends." );
+
+  if ( co->sqpoll && co->backend != BACKEND_URING )
+    fatal_error ( "--sqpoll is only available to the uring backend." );
+
+  if ( co->cpus && ! check_cpu_list ( co->cpus ) )
+    fatal_error ( "Invalid CPU list '%s'.", co->cpus );
+
+  if ( co->pps && co->bps )
+    fatal_error ( "--pps and --bps cannot be used together." );
+
+  /* The rate is split between workers. None of them may get 0 (unlimited). */
+  if ( ( co->pps && co->pps < co->workers ) || ( co->bps && co->bps < co->workers ) )
+    fatal_error ( "Rate must be, at least, 1 per worker." );
+
+  if ( co->txtime )
+  {
+    if ( !co->pps && !co->bps )
+      fatal_error ( "--txtime needs a rate (--pps or --bps)." );
+
+    if ( co->backend != BACKEND_RAW )
+      fatal_error ( "--txtime is only available to the raw backend." );
+  }
+
+  if ( co->rng == RNG_RDRAND && ! rdrand_supported() )
+    fatal_error ( "RDRAND isn't supported by this processor." );
+
+  if ( co->rng == RNG_RDRAND && co->seed_given )
+    fatal_error ( "--seed cannot be used with --rng rdrand." );
+
+  if ( co->permute && co->targets )
+    fatal_error ( "--permute cannot be used with --targets." );
+
+  if ( co->permute && co->sources )
+    fatal_error ( "--permute cannot be used with --sources." );
+
+  if ( co->sources && co->ip.saddr )
+    fatal_error ( "--sources cannot be used with --saddr." );
+
+  ptbl = find_option ( "--sport-mode" );
+  if ( ptbl && ptbl->in_use_ && !co->sports )
+    fatal_error ( "--sport-mode needs a ports list on --sport." );
+
+  ptbl = find_option ( "--dport-mode" );
+  if ( ptbl && ptbl->in_use_ && !co->dports )
+    fatal_error ( "--dport-mode needs a ports list on --dport." );
+
+  if ( !co->pipeline )
+  {
+    if ( find_option ( "--builders" )->in_use_ ||
+         find_option ( "--ring-depth" )->in_use_ ||
+         find_option ( "--ring-slot" )->in_use_ )
+      fatal_error ( "--builders, --ring-depth and --ring-slot need --pipeline." );
+  }
+  else if ( co->ring_depth & ( co->ring_depth - 1 ) )
+    fatal_error ( "--ring-depth must be a power of 2." );
+
+  if ( co->pregen )
+  {
+    if ( co->pipeline )
+      fatal_error ( "--pregen cannot be used with --pipeline." );
+
+    if ( co->pregen < co->workers )
+      fatal_error ( "--pregen needs, at least, 1 packet per worker." );
+  }
+
+  if ( co->proto_run > 1 && co->ip.protocol != IPPROTO_T50 )
+    fatal_error ( "--proto-run needs T50 protocol." );
+
   /* ***** NOTE: Insert other rules here! ***** */
 
   // Checks here if protocol isn't IPPROTO_T50 and if the set of options
@@ -727,15 +852,140 @@ void get_ip_protocol ( config_options_T * restrict co, char * restrict arg )
   }
 }
 
-void set_destination_addresses ( char * restrict arg, config_options_T * restrict co )
+/* Get the transmit backend. */
+void get_backend ( config_options_T * restrict co, char * restrict arg )
+{
+  backends_table_T *ptbl;
+
+  ptbl = backends_table;
+  while ( ptbl->name )
+  {
+    if ( !strcasecmp ( ptbl->name, arg ) )
+    {
+      co->backend = ptbl->backend_id;
+      return;
+    }
+
+    ptbl++;
+  }
+
+  fatal_error ( "Unknown backend %s.", arg );
+}
+
+/* Get the backpressure strategy.
+   NOTE: Names must follow the order of BACKPRESSURE_* identifiers. */
+void get_backpressure ( config_options_T * restrict co, char * restrict arg )
+{
+  static char *names[] = { "poll", "retry", "drop", NULL };
+  char **p;
+
+  p = names;
+  while ( *p )
+  {
+    if ( !strcasecmp ( *p, arg ) )
+    {
+      co->backpressure = p - names;
+      return;
+    }
+
+    p++;
+  }
+
+  fatal_error ( "Unknown backpressure strategy %s.", arg );
+}
+
+/* Get the qdisc used to release packets on their departure times.
+   NOTE: Names must follow the order of TXTIME_* identifiers. */
+void get_txtime ( config_options_T * restrict co, char * restrict arg )
+{
+  static char *names[] = { "none", "etf", "fq", NULL };
+  char **p;
+
+  p = names;
+  while ( *p )
+  {
+    if ( !strcasecmp ( *p, arg ) )
+    {
+      co->txtime = p - names;
+      return;
+    }
+
+    p++;
+  }
+
+  fatal_error ( "Unknown txtime qdisc %s.", arg );
+}
+
+/* Get the random number generator.
+   NOTE: Names must follow the order of RNG_* identifiers. */
+void get_rng ( config_options_T * restrict co, char * restrict arg )
+{
+  static char *names[] = { "xorshift", "rdrand", NULL };
+  char **p;
+
+  p = names;
+  while ( *p )
+  {
+    if ( !strcasecmp ( *p, arg ) )
+    {
+      co->rng = p - names;
+      return;
+    }
+
+    p++;
+  }
+
+  fatal_error ( "Unknown random number generator %s.", arg );
+}
+
+/* Get the ports list mode (--sport-mode and --dport-mode). */
+int get_port_mode ( char * restrict optname, char * restrict arg )
+{
+  static char *names[] = { "seq", "rr", "random", "permute", NULL };
+  char **p;
+
+  p = names;
+  while ( *p )
+  {
+    if ( !strcasecmp ( *p, arg ) )
+      return p - names;
+
+    p++;
+  }
+
+  fatal_error ( "Unknown mode %s for option '%s'.", arg, optname );
+  return PORTS_SEQ;
+}
+
+/* Get a MAC address in "xx:xx:xx:xx:xx:xx" format. */
+void get_mac_address ( uint8_t * restrict mac, char * restrict optname, char * restrict arg )
+{
+  unsigned int m[6];
+  char c;
+  int i;
+
+  if ( sscanf ( arg, "%2x:%2x:%2x:%2x:%2x:%2x%c", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &c ) != 6 )
+    fatal_error ( "Invalid MAC address '%s' for option '%s'.", arg, optname );
+
+  i = 0;
+  while ( i < 6 )
+  {
+    mac[i] = m[i];
+    i++;
+  }
+}
+
+/* Gets the address (in network order) and the CIDR bits of the target
+   (or of --saddr). */
+void set_addresses ( char * restrict arg, in_addr_t * restrict address, uint32_t * restrict bits )
 {
   char *p;
   addr_T addr;
 
   if ( get_ip_and_cidr_from_string ( arg, &addr ) )
   {
-    co->bits = addr.cidr;
-    co->ip.daddr = htonl ( addr.addr );
+    *bits = addr.cidr;
+    *address = htonl ( addr.addr );
   }
   else
   {
@@ -743,14 +993,14 @@ void set_destination_addresses ( char * restrict arg, config_options_T * restric
 
     /* Tries to resolve the name. */
     p = strtok ( arg, "/" );
-    co->ip.daddr = resolv ( p );
+    *address = resolv ( p );
 
     /* Get cidr if any. */
     p = strtok( NULL, "/" );
     if ( p )
-      co->bits = atoi ( p ); /* NOTE: Range will be checked later. */
+      *bits = atoi ( p ); /* NOTE: Range will be checked later. */
     else
-      co->bits = CIDR_MAXIMUM;
+      *bits = CIDR_MAXIMUM;
   }
 }
 
@@ -767,6 +1017,8 @@ void set_config_option ( config_options_T * restrict co, char * restrict optname
 #ifdef __HAVE_TURBO__
     case OPTION_TURBO:
       co->turbo = 1;
+      if ( co->workers < 2 )
+        co->workers = 2;
       break;
 #endif
 
@@ -790,6 +1042,120 @@ void set_config_option ( config_options_T * restrict co, char * restrict optname
       co->shuffle = 1;
       break;
 
+    case OPTION_BATCH:
+      co->batch = toULongCheckRange ( optname, arg, 1, TX_BATCH_MAX );
+      break;
+
+    case OPTION_BACKEND:
+      get_backend ( co, arg );
+      break;
+
+    case OPTION_IFACE:
+      if ( strlen ( arg ) >= IFNAMSIZ )
+        fatal_error ( "Interface name '%s' is too long.", arg );
+      co->iface = arg;
+      break;
+
+    case OPTION_DMAC:
+      get_mac_address ( co->dmac, optname, arg );
+      break;
+
+    case OPTION_QDISC_BYPASS:
+      co->qdisc_bypass = 1;
+      break;
+
+    case OPTION_SQPOLL:
+      co->sqpoll = 1;
+      break;
+
+    case OPTION_BACKPRESSURE:
+      get_backpressure ( co, arg );
+      break;
+
+    case OPTION_WORKERS:
+      /* "auto" means one worker per online CPU. */
+      if ( !strcasecmp ( arg, "auto" ) )
+      {
+        long n;
+
+        if ( ( n = sysconf ( _SC_NPROCESSORS_ONLN ) ) < 1 )
+          n = 1;
+
+        co->workers = n > WORKERS_MAX ? WORKERS_MAX : n;
+      }
+      else
+        co->workers = toULongCheckRange ( optname, arg, 1, WORKERS_MAX );
+      break;
+
+    case OPTION_CPUS:
+      co->cpus = arg;     /* NOTE: Parsed by run_workers(). */
+      break;
+
+    case OPTION_PPS:
+      co->pps = toRate ( optname, arg );
+      break;
+
+    case OPTION_BPS:
+      co->bps = toRate ( optname, arg );
+      break;
+
+    case OPTION_TXTIME:
+      get_txtime ( co, arg );
+      break;
+
+    case OPTION_RNG:
+      get_rng ( co, arg );
+      break;
+
+    case OPTION_SEED:
+      co->seed = toULongLong ( optname, arg );
+      co->seed_given = 1;
+      break;
+
+    case OPTION_PERMUTE:
+      co->permute = 1;
+      break;
+
+    case OPTION_TARGETS:
+      co->targets = arg;
+      break;
+
+    case OPTION_SOURCES:
+      co->sources = arg;
+      break;
+
+    case OPTION_SPORT_MODE:
+      co->sport_mode = get_port_mode ( optname, arg );
+      break;
+
+    case OPTION_DPORT_MODE:
+      co->dport_mode = get_port_mode ( optname, arg );
+      break;
+
+    case OPTION_PIPELINE:
+      co->pipeline = 1;
+      break;
+
+    case OPTION_BUILDERS:
+      co->builders = toULongCheckRange ( optname, arg, 1, BUILDERS_MAX );
+      break;
+
+    case OPTION_RING_DEPTH:
+      co->ring_depth = toULongCheckRange ( optname, arg, RING_DEPTH_MIN, RING_DEPTH_MAX );
+      break;
+
+    case OPTION_RING_SLOT:
+      co->ring_slot = toULongCheckRange ( optname, arg, RING_SLOT_MIN, RING_SLOT_MAX );
+      break;
+
+    case OPTION_PREGEN:
+      co->pregen = toULongCheckRange ( optname, arg, 1, PREGEN_MAX );
+      break;
+
+    case OPTION_PROTO_RUN:
+      co->proto_run = toULongCheckRange ( optname, arg, 1, PROTO_RUN_MAX );
+      break;
+
     // --- GRE options
     // FIXME: gre.flags, gre.recur, optional gre.offset, not set here!
     case OPTION_GRE_SEQUENCE_PRESENT:
@@ -1748,25 +2114,30 @@ void set_config_option ( config_options_T * restrict co, char * restrict optname
       co->ospf.sequence = htonl ( toULong ( optname, arg ) );
       break;
 
-    /*
-     * FIXME: These options should deal with lists, but only the first item
-     *        is used...
-     */
+    /* NOTE: Ports lists ("n-m,...") are expanded by load_ports(). */
     // Source port.
     case OPTION_SOURCE:
-      check_list_separators ( optname, arg );
-      co->source = htons ( toULongCheckRange ( optname, arg, 0, 65535 ) );
+      if ( strpbrk ( arg, ",-" ) )
+        co->sports = arg;
+      else
+        co->source = htons ( toULongCheckRange ( optname, arg, 0, 65535 ) );
       break;
 
     // Destination port
     case OPTION_DESTINATION:
-      check_list_separators ( optname, arg );
-      co->dest   = htons ( toULongCheckRange ( optname, arg, 0, 65535 ) );
+      if ( strpbrk ( arg, ",-" ) )
+        co->dports = arg;
+      else
+        co->dest   = htons ( toULongCheckRange ( optname, arg, 0, 65535 ) );
       break;
 
     case OPTION_IP_SOURCE:
       check_list_separators ( optname, arg );
-      co->ip.saddr = resolv ( arg );
+      set_addresses ( arg, &co->ip.saddr, &co->sbits );
+
+      /* A single address isn't a range. */
+      if ( co->sbits >= CIDR_MAXIMUM )
+        co->sbits = 0;
       break;
 
     case OPTION_IP_PROTOCOL:
@@ -1805,6 +2176,59 @@ uint32_t toULong ( char * restrict optname, char * restrict value )
   return ( uint32_t ) n;
 }
 
+/* Same as toULong(), but for 64 bits values. */
+uint64_t toULongLong ( char * restrict optname, char * restrict value )
+{
+  unsigned long long n = 0;
+  char *p;
+
+  // strtoull() accepts negative values, we don't!
+  if ( !value || !*value || strchr ( value, '-' ) )
+    goto error_exit;
+
+  errno = 0;
+  n = strtoull ( value, &p, 0 );
+
+  if ( errno || *p )
+  {
+  error_exit:
+    fatal_error ( "Invalid numeric value for option '%s'.", optname );
+  }
+
+  return n;
+}
+
+/* Converts a rate, with an optional 'k', 'M' or 'G' suffix (powers of 10),
+   as in "10M". */
+uint64_t toRate ( char * restrict optname, char * restrict value )
+{
+  uint64_t n = 0, m = 1;
+  char *p;
+
+  if ( !isdigit ( *value ) )
+    goto error_exit;
+
+  errno = 0;
+  n = strtoull ( value, &p, 10 );
+
+  switch ( *p )
+  {
+    case 'k': case 'K': m = 1000ULL; p++; break;
+    case 'm': case 'M': m = 1000000ULL; p++; break;
+    case 'g': case 'G': m = 1000000000ULL; p++; break;
+  }
+
+  /* NOTE: Limited to 10^12, to avoid overflows on the pacing arithmetic.
+           Checked before the multiplication, which could wrap. */
+  if ( errno || *p || !n || n > 1000000000000ULL / m )
+  {
+  error_exit:
+    fatal_error ( "Invalid rate for option '%s'.", optname );
+  }
+
+  return n * m;
+}
+
 /* Tries to convert string to uint32_t, checking range.
    NOTE: 'min' MUST BE smaller than 'max'.
    NOTE: Marked as "noinline" because it's big enough. */
@@ -0,0 +1,193 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file corpus.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Packets corpus (--pregen).
+
+   Every worker builds its share of the packets once, then sends them
+   over and over, without calling the modules again.
+
+   The packets are appended to a staging buffer (its size isn't known in
+   advance) and, when all of them are built, moved to a single arena, on
+   hugepages if there are any available (or, at least, advised to be
+   backed by transparent hugepages), so the replay does few TLB misses.
+   The index has 8 bytes per packet: Its offset on the arena (48 bits)
+   and its size (16 bits). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <t50_defines.h>
+#include <t50_errors.h>
+#include <t50_corpus.h>
+
+#define HUGEPAGE_SIZE_DEFAULT ( 2U << 20 )
+#define CORPUS_ALIGN          8             /* Packets alignment, on the arena. */
+#define CORPUS_PACKET_MAX     65535         /* Size fits in 16 bits. */
+
+typedef struct
+{
+  uint64_t offset : 48;
+  uint64_t size   : 16;
+} corpus_entry_T;
+
+/* NOTE: Every worker has its own corpus. */
+static _Thread_local corpus_entry_T *corpus_index = NULL;
+static _Thread_local uint32_t        corpus_count = 0;
+static _Thread_local uint32_t        corpus_next_entry = 0;
+static _Thread_local uint8_t        *staging = NULL;
+static _Thread_local size_t          staging_size = 0;
+static _Thread_local size_t          used = 0;
+static _Thread_local uint8_t        *arena = NULL;
+static _Thread_local size_t          arena_size = 0;   /* Mapped size. */
+
+/* Gets the default hugepage size (from /proc/meminfo). */
+static size_t get_hugepage_size ( void )
+{
+  char line[128];
+  unsigned long kb;
+  FILE *f;
+
+  kb = 0;
+  if ( ( f = fopen ( "/proc/meminfo", "r" ) ) != NULL )
+  {
+    while ( fgets ( line, sizeof line, f ) )
+      if ( sscanf ( line, "Hugepagesize: %lu kB", &kb ) == 1 )
+        break;
+
+    fclose ( f );
+  }
+
+  return kb ? kb << 10 : HUGEPAGE_SIZE_DEFAULT;
+}
+
+/**
+ * Starts a corpus.
+ *
+ * @param count Number of packets it will hold.
+ */
+void corpus_create ( uint32_t count )
+{
+  if ( ! ( corpus_index = malloc ( count * sizeof *corpus_index ) ) )
+    fatal_error ( "Cannot allocate the index of %u packets.", count );
+
+  corpus_count = corpus_next_entry = 0;
+  used = 0;
+
+  /* Room for the packets of the default size (it grows, if needed). */
+  staging_size = ( size_t ) count * 64;
+  if ( ! ( staging = malloc ( staging_size ) ) )
+    fatal_error ( "Cannot allocate memory for %u packets.", count );
+}
+
+/* Appends a packet to the corpus. */
+void corpus_add ( const void *buffer, size_t size )
+{
+  size_t offset;
+  void *p;
+
+  if ( size > CORPUS_PACKET_MAX )
+    fatal_error ( "Packet (%zu bytes) is too big for the corpus.", size );
+
+  offset = ( used + CORPUS_ALIGN - 1 ) & ~( size_t ) ( CORPUS_ALIGN - 1 );
+
+  /* NOTE: Assume the buffer is big enough the majority of time. */
+  if ( offset + size > staging_size )
+  {
+    staging_size = 2 * ( offset + size );
+
+    if ( ! ( p = realloc ( staging, staging_size ) ) )
+      fatal_error ( "Cannot allocate memory for the corpus (%zu bytes).", staging_size );
+
+    staging = p;
+  }
+
+  memcpy ( staging + offset, buffer, size );
+  used = offset + size;
+
+  corpus_index[corpus_count].offset = offset;
+  corpus_index[corpus_count].size = size;
+  corpus_count++;
+}
+
+/**
+ * Moves the corpus to its arena.
+ *
+ * @param size Pointer where the size of the arena is stored.
+ * @return true if the arena is on hugepages.
+ */
+_Bool corpus_seal ( size_t *size )
+{
+  size_t hsize;
+  _Bool huge;
+
+  hsize = get_hugepage_size();
+  arena_size = ( used + hsize - 1 ) & ~( hsize - 1 );
+
+  huge = 1;
+  if ( ( arena = mmap ( NULL, arena_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                        -1, 0 ) ) == MAP_FAILED )
+  {
+    /* No hugepages reserved? Ask for transparent ones. */
+    huge = 0;
+    arena_size = used;
+    if ( ( arena = mmap ( NULL, arena_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 ) ) == MAP_FAILED )
+      fatal_error ( "Cannot allocate the corpus arena (%zu bytes).", used );
+
+    madvise ( arena, arena_size, MADV_HUGEPAGE );   // NOTE: May fail. It's ok.
+  }
+
+  memcpy ( arena, staging, used );
+
+  SAFE_FREE ( staging );
+  staging_size = 0;
+
+  *size = used;
+  return huge;
+}
+
+/* Gets the next packet (back to the first one, after the last). */
+const void *corpus_next ( size_t *size )
+{
+  const corpus_entry_T *e;
+
+  e = &corpus_index[corpus_next_entry];
+  if ( ++corpus_next_entry == corpus_count )
+    corpus_next_entry = 0;
+
+  *size = e->size;
+  return arena + e->offset;
+}
+
+void corpus_destroy ( void )
+{
+  if ( arena )
+  {
+    munmap ( arena, arena_size );
+    arena = NULL;
+  }
+
+  SAFE_FREE ( staging );
+  SAFE_FREE ( corpus_index );
+  corpus_count = 0;
+}
@@ -28,12 +28,35 @@ void general_help ( void )
   puts ( "Common Options:\n"
          "    --threshold NUM           Threshold of packets to send     (default 1000)\n"
          "    --flood                   This option supersedes the \'threshold\'\n"
+         "    --batch NUM               Packets per sendmmsg() call      (default 1)\n"
+         "    --backend NAME            Backend: raw,packet,xdp or uring (default raw)\n"
+         "    --iface NAME              Output network interface\n"
+         "    --dmac MAC                Destination MAC address          (default broadcast)\n"
+         "    --qdisc-bypass            Bypass the qdisc layer           (default OFF)\n"
+         "    --sqpoll                  io_uring submission polling      (default OFF)\n"
+         "    --backpressure MODE       Full queue: poll, retry or drop  (default poll)\n"
+         "    --workers NUM|auto        Number of worker threads         (default 1)\n"
+         "    --cpus LIST               Pin workers to CPUs (ex: 2-9,12) (default iface node)\n"
+         "    --pipeline                Builder threads feed the sender  (default OFF)\n"
+         "    --builders NUM            Builder threads per worker       (default 1)\n"
+         "    --ring-depth NUM          Slots on each ring (power of 2)  (default 1024)\n"
+         "    --ring-slot BYTES         Size of each ring slot           (default 2048)\n"
+         "    --pregen NUM              Build NUM packets, replay them   (default OFF)\n"
+         "    --pps RATE                Packets per second (ex: 100k)    (default unlimited)\n"
+         "    --bps RATE                Bits per second (ex: 10M)        (default unlimited)\n"
+         "    --txtime QDISC            Departure times: none, etf or fq (default none)\n"
+         "    --rng NAME                Random numbers: xorshift, rdrand (default xorshift)\n"
+         "    --seed NUM                Random seed (repeats a run)      (default RANDOM)\n"
+         "    --permute                 Each address once, random order  (default OFF)\n"
+         "    --targets FILE            Targets list (CIDRs and weights) (default NONE)\n"
+         "    --sources FILE            Source addresses pool (as above) (default NONE)\n"
          "    --encapsulated            Encapsulated protocol (GRE)      (default OFF)\n"
          " -B,--bogus-csum              Bogus checksum                   (default OFF)\n"
          "    --shuffle                 Shuffling for T50 protocol       (default OFF)\n"
+         "    --proto-run NUM           Packets per protocol, in a row   (default 1)\n"
          " -q,--quiet                   Disable INFOs\n"
 #ifdef  __HAVE_TURBO__
-         "    --turbo                   Extend the performance           (default OFF)\n"
+         "    --turbo                   Same as --workers 2              (default OFF)\n"
 #endif  /* __HAVE_TURBO__ */
          " -l,--list-protocols          List all available protocols\n"
          " -v,--version                 Print version and exit\n"
@@ -26,7 +26,7 @@
 void ip_help ( void )
 {
   printf ( "IP Options:\n"
-           " -s,--saddr ADDR              IP source IP address             (default RANDOM)\n"
+           " -s,--saddr ADDR[/CIDR]       IP source IP address (or range)  (default RANDOM)\n"
            "    --tos NUM                 IP type of service               (default 0x%x)\n"
            "    --id NUM                  IP identification                (default RANDOM)\n"
            "    --frag-offset NUM         IP fragmentation offset          (default 0)\n"
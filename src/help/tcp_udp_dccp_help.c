@@ -28,8 +28,10 @@
 void tcp_udp_dccp_help ( void )
 {
   puts ( "DCCP/TCP/UDP Options:\n"
-         "    --sport NUM               DCCP|TCP|UDP source port         (default RANDOM)\n"
-         "    --dport NUM               DCCP|TCP|UDP destination port    (default RANDOM)\n" );
+         "    --sport NUM[-NUM][,...]   DCCP|TCP|UDP source ports        (default RANDOM)\n"
+         "    --dport NUM[-NUM][,...]   DCCP|TCP|UDP destination ports   (default RANDOM)\n"
+         "    --sport-mode MODE         seq, rr, random or permute       (default seq)\n"
+         "    --dport-mode MODE         seq, rr, random or permute       (default seq)\n" );
 
 }
 
@@ -20,7 +20,7 @@
 /* Define to the home page for this package. */
 #define PACKAGE_URL "https://gitlab.com/fredericopissarra/t50.git"
 
-/* Use fork to spawn extra process */
+/* --turbo option (same as --workers 2) */
 #define __HAVE_TURBO__
 
 #endif
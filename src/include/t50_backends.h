@@ -0,0 +1,98 @@
+/* vim: set ts=2 et sw=2 : */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2014 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BACKENDS_INCLUDED__
+#define __BACKENDS_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <t50_typedefs.h>
+#include <t50_config.h>
+
+/* Transmit backends identifiers (index on backends table). */
+enum
+{
+  BACKEND_RAW = 0,
+  BACKEND_PACKET,
+  BACKEND_XDP,
+  BACKEND_URING
+  /* NOTE: Add new backends here and on the backends table @ netio.c. */
+};
+
+/**
+ * Transmit backends entry structure.
+ *
+ * create_socket(), get_packet_slot(), send_packet(), flush_packets() and
+ * close_socket() are dispatched to the selected backend through this table.
+ */
+typedef struct
+{
+  int backend_id;
+  char *name;
+  char *description;
+  void  ( *create ) ( const config_options_T * const restrict );
+  void  ( *close ) ( void );
+  void *( *get_slot ) ( size_t * );
+  int   ( *send ) ( const void * const, size_t, const config_options_T * const restrict );
+  int   ( *flush ) ( void );
+} backends_table_T;
+
+/* Macros used to define the backends table. */
+#define BEGIN_BACKENDS_TABLE backends_table_T backends_table[] = {
+#define END_BACKENDS_TABLE { 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL } };
+#define BACKEND_ENTRY(id,name,descr,pfx) \
+  { (id), name, descr, pfx ## _create, pfx ## _close, pfx ## _get_slot, pfx ## _send, pfx ## _flush },
+
+extern backends_table_T backends_table[];
+
+/* Network interface helpers, used by link layer backends. */
+int  get_iface_index ( const char * const );
+void get_iface_hwaddr ( const char * const, uint8_t * );
+
+/* Raw socket creation, used by IP layer backends. */
+int  raw_socket ( const config_options_T * const restrict, _Bool );
+
+/* Backpressure handling and accounting. */
+int  backpressure ( int, unsigned int * );
+int  wait_for_io ( int, short );
+
+/* AF_PACKET TX_RING backend (txring.c). */
+void  txring_create ( const config_options_T * const restrict );
+void  txring_close ( void );
+void *txring_get_slot ( size_t * );
+int   txring_send ( const void * const, size_t, const config_options_T * const restrict );
+int   txring_flush ( void );
+
+/* AF_XDP backend (xdp.c). */
+void  xdp_create ( const config_options_T * const restrict );
+void  xdp_close ( void );
+void *xdp_get_slot ( size_t * );
+int   xdp_send ( const void * const, size_t, const config_options_T * const restrict );
+int   xdp_flush ( void );
+
+/* io_uring backend (uring.c). */
+void  uring_create ( const config_options_T * const restrict );
+void  uring_close ( void );
+void *uring_get_slot ( size_t * );
+int   uring_send ( const void * const, size_t, const config_options_T * const restrict );
+int   uring_flush ( void );
+/* --- add yours here */
+
+#endif
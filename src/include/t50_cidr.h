@@ -28,14 +28,31 @@
 #define CIDR_MINIMUM 8
 #define CIDR_MAXIMUM 32 // fix #7
 
+#define SWEEP_ROUNDS 4
+
 /** @struct cidr
     T50 cidr structure. */
 struct cidr
 {
   uint32_t  hostid;       /* hosts identifiers */
   in_addr_t __1st_addr;   /* first IP address  */
+
+  /* Permutation of the hosts (--permute). */
+  uint32_t  keys[SWEEP_ROUNDS];
+  uint8_t   lo_bits, hi_bits;
 };
 
+/* Host indexes swept by a worker (--permute). */
+typedef struct
+{
+  uint32_t next, start, end;
+} sweep_T;
+
 struct cidr *config_cidr ( const config_options_T * const );
+struct cidr *config_source_cidr ( const config_options_T * const );
+
+/* Address sweep (--permute). */
+void         init_sweep ( const struct cidr * const, sweep_T *, unsigned int, unsigned int );
+uint32_t     next_host ( const struct cidr * const, sweep_T * );
 
 #endif
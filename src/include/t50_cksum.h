@@ -24,6 +24,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
-uint16_t cksum ( void *, size_t );
+/* Checksum routine (the best one for this processor). */
+typedef struct
+{
+  const char *name;
+  uint16_t ( *func ) ( void *, size_t );
+} cksum_impl_T;
+
+extern uint16_t ( *cksum ) ( void *, size_t );
+const cksum_impl_T *get_cksum_impls ( void );
+
+/* Incremental update (RFC 1624). */
+uint32_t cksum_base ( uint16_t );
+uint32_t cksum_remove ( uint32_t, uint32_t, unsigned int );
+uint16_t cksum_finish ( uint32_t );
 
 #endif
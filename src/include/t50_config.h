@@ -47,6 +47,31 @@ enum
   OPTION_LIST_PROTOCOLS,
   OPTION_BOGUSCSUM,
   OPTION_SHUFFLE,
+  OPTION_BATCH,
+  OPTION_BACKEND,
+  OPTION_IFACE,
+  OPTION_DMAC,
+  OPTION_QDISC_BYPASS,
+  OPTION_SQPOLL,
+  OPTION_BACKPRESSURE,
+  OPTION_WORKERS,
+  OPTION_CPUS,
+  OPTION_PPS,
+  OPTION_BPS,
+  OPTION_TXTIME,
+  OPTION_RNG,
+  OPTION_SEED,
+  OPTION_PERMUTE,
+  OPTION_TARGETS,
+  OPTION_SOURCES,
+  OPTION_SPORT_MODE,
+  OPTION_DPORT_MODE,
+  OPTION_PIPELINE,
+  OPTION_BUILDERS,
+  OPTION_RING_DEPTH,
+  OPTION_RING_SLOT,
+  OPTION_PREGEN,
+  OPTION_PROTO_RUN,
 
   /* XXX DCCP, TCP & UDP HEADER OPTIONS            */
   OPTION_SOURCE,
@@ -300,14 +325,43 @@ struct config_options
   _Bool     bogus_csum;             /* bogus packet checksum       */
   _Bool     shuffle;                /* Shuffling option for T50 proto. */
   _Bool     quiet;                  /* Non-verbose mode. */
+  uint32_t  batch;                  /* packets per sendmmsg() call */
+  int       backend;                /* transmit backend            */
+  char     *iface;                  /* output interface            */
+  uint8_t   dmac[6];                /* destination MAC address     */
+  _Bool     qdisc_bypass;           /* bypass the qdisc layer      */
+  _Bool     sqpoll;                 /* io_uring SQ polling thread  */
+  int       backpressure;           /* backpressure strategy       */
+  uint32_t  workers;                /* number of worker threads    */
+  char     *cpus;                   /* CPU list (workers affinity) */
+  uint64_t  pps;                    /* rate limit (packets/second) */
+  uint64_t  bps;                    /* rate limit (bits/second)    */
+  int       txtime;                 /* SO_TXTIME pacing (qdisc)    */
+  int       rng;                    /* random number generator     */
+  uint64_t  seed;                   /* random seed                 */
+  _Bool     seed_given;             /* --seed was used             */
+  _Bool     permute;                /* sweep all addresses (CIDR)  */
+  char     *targets;                /* target list file            */
+  char     *sources;                /* source pool file            */
+  _Bool     pipeline;               /* builder threads + sender    */
+  uint32_t  builders;               /* builders per worker         */
+  uint32_t  ring_depth;             /* slots on each builder ring  */
+  uint32_t  ring_slot;              /* bytes on each ring slot     */
+  uint32_t  pregen;                 /* packets built up front      */
+  uint32_t  proto_run;              /* packets per protocol (T50)  */
 #ifdef  __HAVE_TURBO__
-  _Bool     turbo;                  /* duplicate the attack        */
+  _Bool     turbo;                  /* same as 2 workers           */
 #endif  /* __HAVE_TURBO__ */
 
   /* XXX DCCP, TCP & UDP HEADER OPTIONS                            */
   uint16_t  source;                 /* general source port         */
   uint16_t  dest;                   /* general destination port    */
+  char     *sports;                 /* source ports list           */
+  char     *dports;                 /* destination ports list      */
+  int       sport_mode;             /* source ports list mode      */
+  int       dport_mode;             /* destination ports list mode */
   uint32_t  bits;                   /* CIDR bits                   */
+  uint32_t  sbits;                  /* source CIDR bits (0 = none) */
 
   /* XXX IP HEADER OPTIONS  (IPPROTO_IP = 0)                       */
   struct
@@ -0,0 +1,34 @@
+/* vim: set ts=2 et sw=2 : */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __T50_CORPUS_INCLUDED__
+#define __T50_CORPUS_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Pre-generated packets (--pregen), per worker. */
+void        corpus_create ( uint32_t );
+void        corpus_add ( const void *, size_t );
+_Bool       corpus_seal ( size_t * );
+const void *corpus_next ( size_t * );
+void        corpus_destroy ( void );
+
+#endif
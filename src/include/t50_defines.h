@@ -25,10 +25,14 @@
 #define _INIT __attribute__((constructor))
 #define _FINI __attribute__((destructor))
 
+/* Used to keep data shared between workers on distinct cache lines. */
+#define CACHE_LINE_SIZE 64
+#define _CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+
 /**
- * Amount of time, in seconds, to wait for child process termination.
+ * Maximum number of workers (threads).
  */
-#define WAIT_FOR_CHILD_TIMEOUT  5
+#define WORKERS_MAX 256
 
 /**
  * Initial packet buffer preallocation size (2 kB).
@@ -38,6 +42,40 @@
  */
 #define INITIAL_PACKET_SIZE 2048
 
+/**
+ * Transmit batching limits.
+ *
+ * TX_BATCH_MAX is the maximum number of packets handed to the kernel
+ * in a single call (sendmmsg() is limited to UIO_MAXIOV messages).
+ * Each batched packet is built in a slot of TX_SLOT_SIZE bytes.
+ */
+#define TX_BATCH_MAX  1024
+#define TX_SLOT_SIZE  INITIAL_PACKET_SIZE
+
+/**
+ * Pipeline limits (--pipeline).
+ *
+ * Each builder thread has a ring of RING_DEPTH_* slots (a power of two),
+ * holding packets up to RING_SLOT_* bytes long.
+ */
+#define BUILDERS_MAX        256
+#define RING_DEPTH_DEFAULT  1024
+#define RING_DEPTH_MIN      16
+#define RING_DEPTH_MAX      ( 1U << 20 )
+#define RING_SLOT_DEFAULT   INITIAL_PACKET_SIZE
+#define RING_SLOT_MIN       256
+#define RING_SLOT_MAX       65536
+
+/**
+ * Maximum number of pre-generated packets (--pregen).
+ */
+#define PREGEN_MAX  ( 1U << 26 )
+
+/**
+ * Maximum number of packets of the same protocol, in a row (--proto-run).
+ */
+#define PROTO_RUN_MAX  65536
+
 #define MAXIMUM_IP_ADDRESSES  ((1U << 24) - 1)
 
 /* #define INADDR_ANY 0 */ // NOTE: Already defined in multiple headers (linux/in.h & netinet/in.h).
@@ -57,10 +95,6 @@
 /** Macro used to test bitmasks */
 #define TEST_BITS(x,bits) ((x) & (bits))
 
-/** Used to test if "pid" from fork() is from a child process. */
-/* NOTE: fork returns always 0 for the child process. */
-#define IS_CHILD_PID(p) (!(p))
-
 #define swap(a,b) { typeof((a)) t; t = (a); (a) = (b); (b) = t; }
 #define SAFE_FREE(ptr) { if ((ptr)) { free((ptr)); (ptr) = NULL; } }
 
@@ -21,11 +21,22 @@
 #ifndef __MEMALLOC_H__
 #define __MEMALLOC_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
-extern void *packet;
+/* Buffer where a packet is built. */
+typedef struct
+{
+  void   *data;
+  size_t  size;         /* Room on the buffer. */
+  int     class_;       /* Arena size class (-1 if it isn't an arena slot). */
+} packet_buffer_T;
 
-void alloc_packet ( size_t );
-void destroy_packet_buffer( void );
+void  init_packet_arena ( unsigned int );
+void  destroy_packet_arena ( void );
+void  packet_get ( packet_buffer_T *, size_t );
+void  packet_wrap ( packet_buffer_T *, void *, size_t );
+void  packet_put ( packet_buffer_T * );
+void *packet_reserve ( packet_buffer_T *, size_t );
 
 #endif
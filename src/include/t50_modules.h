@@ -26,6 +26,8 @@
 #include <netinet/in.h>
 #include <t50_typedefs.h>
 #include <t50_config.h>
+#include <t50_memalloc.h>
+#include <t50_template.h>
 
 /* Purpose-built protocol libraries to be used by T50 modules */
 #include <protocol/t50_ip.h>
@@ -75,7 +77,27 @@ struct psdhdr
   uint16_t  len;        /* header length       */
 };
 
-typedef void ( *module_func_ptr_t ) ( const config_options_T * const restrict, size_t * restrict );
+/* What changes from one packet to the next (see the batch functions). */
+typedef struct
+{
+  in_addr_t daddr;      /* destination address */
+  in_addr_t saddr;      /* source address      */
+  uint16_t  source;     /* source port         */
+  uint16_t  dest;       /* destination port    */
+} packet_vars_T;
+
+static inline void set_packet_vars ( config_options_T * const restrict co, const packet_vars_T * restrict v )
+{
+  co->ip.daddr = v->daddr;
+  co->ip.saddr = v->saddr;
+  co->source = v->source;
+  co->dest = v->dest;
+}
+
+typedef void ( *module_func_ptr_t ) ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+typedef int ( *module_template_ptr_t ) ( const config_options_T * const restrict, packet_buffer_T * restrict, template_T * restrict );
+typedef void ( *module_batch_ptr_t ) ( config_options_T * const restrict, const packet_vars_T * restrict,
+                                       packet_buffer_T * restrict, size_t * restrict, unsigned int );
 
 /**
  * Modules entry structure.
@@ -88,13 +110,19 @@ typedef struct
   char *name;
   char *description;
   module_func_ptr_t func;
+  module_template_ptr_t template_func;  /* NULL if the module has no template. */
+  module_batch_ptr_t batch_func;        /* NULL if the module has no batch function. */
   int *valid_options;
 } modules_table_T;
 
-/* Macros used to define the modules table. */
+/* Macros used to define the modules table.
+   MODULE_ENTRY_TEMPLATE is used by modules with a template function (func_template).
+   MODULE_ENTRY_BATCH is used by modules with template and batch functions (func_batch). */
 #define BEGIN_MODULES_TABLE modules_table_T mod_table[] = {
-#define END_MODULES_TABLE { 0, NULL, NULL, NULL, NULL } };
-#define MODULE_ENTRY(id,name,descr,func) { (id), name, descr, func, func ## _validopts },
+#define END_MODULES_TABLE { 0, NULL, NULL, NULL, NULL, NULL, NULL } };
+#define MODULE_ENTRY(id,name,descr,func) { (id), name, descr, func, NULL, NULL, func ## _validopts },
+#define MODULE_ENTRY_TEMPLATE(id,name,descr,func) { (id), name, descr, func, func ## _template, NULL, func ## _validopts },
+#define MODULE_ENTRY_BATCH(id,name,descr,func) { (id), name, descr, func, func ## _template, func ## _batch, func ## _validopts },
 
 #define VALID_OPTIONS_TABLE(func, ...) static int func ## _validopts[] = { __VA_ARGS__, 0 };
 
@@ -103,26 +131,37 @@ typedef struct
  */
 extern modules_table_T mod_table[]; // Must be extern here!
 extern const uint32_t number_of_modules;
-extern uint32_t indices[];
+extern _Thread_local uint32_t indices[];
 
 int    *get_module_valid_options_list ( int );
 void    build_proto_indices ( void );
 uint32_t get_proto_index ( config_options_T * );
 
 /* Modules functions prototypes. */
-void icmp ( const config_options_T * const restrict, size_t * restrict );
-void igmpv1 ( const config_options_T * const restrict, size_t * restrict );
-void igmpv3 ( const config_options_T * const restrict, size_t * restrict );
-void tcp ( const config_options_T * const restrict, size_t * restrict );
-void egp ( const config_options_T * const restrict, size_t * restrict );
-void udp ( const config_options_T * const restrict, size_t * restrict );
-void ripv1 ( const config_options_T * const restrict, size_t * restrict );
-void ripv2 ( const config_options_T * const restrict, size_t * restrict );
-void dccp ( const config_options_T * const restrict, size_t * restrict );
-void rsvp ( const config_options_T * const restrict, size_t * restrict );
-void ipsec ( const config_options_T * const restrict, size_t * restrict );
-void eigrp ( const config_options_T * const restrict, size_t * restrict );
-void ospf ( const config_options_T * const restrict, size_t * restrict );
+void icmp ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void igmpv1 ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void igmpv3 ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void tcp ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void egp ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void udp ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void ripv1 ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void ripv2 ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void dccp ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void rsvp ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void ipsec ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void eigrp ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
+void ospf ( const config_options_T * const restrict, packet_buffer_T * restrict, size_t * restrict );
 /* --- add yours here */
 
+/* Modules templates prototypes. */
+int  icmp_template ( const config_options_T * const restrict, packet_buffer_T * restrict, template_T * restrict );
+int  tcp_template ( const config_options_T * const restrict, packet_buffer_T * restrict, template_T * restrict );
+int  udp_template ( const config_options_T * const restrict, packet_buffer_T * restrict, template_T * restrict );
+
+/* Modules batch functions prototypes. */
+void tcp_batch ( config_options_T * const restrict, const packet_vars_T * restrict,
+                 packet_buffer_T * restrict, size_t * restrict, unsigned int );
+void udp_batch ( config_options_T * const restrict, const packet_vars_T * restrict,
+                 packet_buffer_T * restrict, size_t * restrict, unsigned int );
+
 #endif
@@ -24,20 +24,53 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <netinet/in.h>
+#include <t50_defines.h>
 #include <t50_typedefs.h>
 #include <t50_config.h>
 
-extern uint64_t bytes_sent;
-extern uint64_t packets_sent;
+/* Backpressure strategies (what to do when the transmit queue is full). */
+enum
+{
+  BACKPRESSURE_POLL = 0,    /* Wait for room, with poll(). */
+  BACKPRESSURE_RETRY,       /* Retry the send a few times, then drop. */
+  BACKPRESSURE_DROP         /* Drop the packet. */
+};
+
+/* Departure time offload (--txtime): which qdisc will release the packets. */
+enum
+{
+  TXTIME_NONE = 0,
+  TXTIME_ETF,               /* ETF qdisc (CLOCK_TAI). */
+  TXTIME_FQ                 /* FQ qdisc (CLOCK_MONOTONIC). */
+};
+
+/* Transmit statistics (one per worker, on its own cache line). */
+typedef struct
+{
+  uint64_t bytes_sent;
+  uint64_t packets_sent;
+  uint64_t packets_dropped;   /* Dropped due to backpressure. */
+  uint64_t send_retries;      /* Sends retried due to backpressure. */
+  uint64_t io_waits;          /* Waits for the kernel (room or completions). */
+  uint64_t blocked_time;      /* Time spent waiting for the kernel (ns). */
+} _CACHE_ALIGNED tx_stats_T;
+
+extern _Thread_local tx_stats_T *tx_stats;
 
 /* Common routines used by code */
 in_addr_t resolv ( char * );      /* Resolve name to ip address. */
-void      create_socket ( void ); /* Creates the sending socket */
+void      create_socket ( const config_options_T * const restrict ); /* Creates the sending socket */
 void      close_socket ( void );  /* Close the previously created socket */
 
+/* Get the slot where the next packet should be built (NULL if none). */
+void     *get_packet_slot ( size_t * );
+
 /* Send the actual packet from buffer, with size bytes, using config options. */
 int       send_packet ( const void * const,
                         size_t,
                         const config_options_T * const restrict );
 
+/* Send packets still waiting on the batch (if batching is used). */
+int       flush_packets ( void );
+
 #endif
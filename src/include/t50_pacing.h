@@ -0,0 +1,34 @@
+/* vim: set ts=2 et sw=2 : */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2014 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __T50_PACING_INCLUDED__
+#define __T50_PACING_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <t50_config.h>
+
+/* Departure time of the current packet (--txtime), in ns. */
+extern _Thread_local uint64_t txtime;
+
+void init_pacing ( const config_options_T * const restrict );
+void pace ( size_t );
+
+#endif
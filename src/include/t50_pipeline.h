@@ -0,0 +1,86 @@
+/* vim: set ts=2 et sw=2 : */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __T50_PIPELINE_INCLUDED__
+#define __T50_PIPELINE_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <t50_defines.h>
+
+/* A built packet, waiting to be sent. */
+typedef struct
+{
+  uint32_t  size;
+  in_addr_t daddr;        /* Network order (raw backends need it). */
+  uint16_t  dest;         /* Destination port (network order). */
+  uint16_t  module;       /* mod_table index (error messages). */
+  _Alignas ( 16 ) uint8_t data[];
+} ring_slot_T;
+
+/* Single producer (builder), single consumer (sender) ring.
+   Each side has its own cache line and only reads the other's index
+   when its cached copy says the ring is full (or empty). */
+typedef struct
+{
+  /* Builder side. */
+  _CACHE_ALIGNED uint32_t head;
+  uint32_t  tail_cache;
+  _Bool     closed;       /* No more packets. */
+  uint64_t  full;         /* Times the builder waited (ring full). */
+
+  /* Sender side. */
+  _CACHE_ALIGNED uint32_t tail;
+  uint32_t  head_cache;
+  uint64_t  empty;        /* Polls which found the ring empty. */
+  uint64_t  occupancy;    /* Sum of the packets waiting, on every poll. */
+  uint64_t  polls;
+
+  /* Read only. */
+  _CACHE_ALIGNED uint32_t mask;
+  uint32_t  slot_size;    /* Room for the packet. */
+  size_t    stride;
+  uint8_t  *slots;
+} ring_T;
+
+/* Pipeline statistics (sums of all rings). */
+typedef struct
+{
+  uint64_t full;
+  uint64_t empty;
+  uint64_t occupancy;
+  uint64_t polls;
+  uint64_t depth;         /* Depth of each ring. */
+} pipeline_stats_T;
+
+ring_T      *ring_create ( uint32_t, uint32_t );
+uint32_t     ring_reserve ( ring_T * );
+uint32_t     ring_wait ( ring_T * );
+ring_slot_T *ring_free_slot ( const ring_T *, uint32_t );
+void         ring_commit ( ring_T *, uint32_t );
+void         ring_close ( ring_T * );
+uint32_t     ring_poll ( ring_T * );
+ring_slot_T *ring_slot ( const ring_T *, uint32_t );
+void         ring_release ( ring_T *, uint32_t );
+_Bool        ring_closed ( const ring_T * );
+void         ring_statistics ( const ring_T *, pipeline_stats_T * );
+
+#endif
@@ -0,0 +1,43 @@
+/* vim: set ts=2 et sw=2 : */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __T50_PORTS_INCLUDED__
+#define __T50_PORTS_INCLUDED__
+
+#include <stdint.h>
+#include <t50_config.h>
+
+/* How ports lists are walked (--sport-mode and --dport-mode).
+   NOTE: Names on get_port_mode() must follow this order. */
+enum port_mode_e
+{
+  PORTS_SEQ = 0,      /* In order, the list split between workers.     */
+  PORTS_RR,           /* In order, the whole list on every worker.     */
+  PORTS_RANDOM,       /* Random port of the list.                      */
+  PORTS_PERMUTE       /* Random order, each port once per cycle.       */
+};
+
+void     load_ports ( const config_options_T * const );
+void     init_ports ( const config_options_T * const, unsigned int, unsigned int );
+void     destroy_ports ( void );
+uint16_t next_sport ( void );
+uint16_t next_dport ( void );
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef __RANDOMIZER_H__
 #define __RANDOMIZER_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <configuration.h>
 
@@ -26,8 +27,38 @@
 #define INADDR_RND(v) ((uint32_t)(!!(v) ? (v) : RANDOM()))
 #define IPPORT_RND(v) ((uint16_t)(!!(v) ? (v) : RANDOM()))
 
-extern uint32_t ( *RANDOM ) ( void );
-extern void ( *SRANDOM ) ( void );
+/* Random number generators (--rng).
+   NOTE: Names on get_rng() must follow this order. */
+enum rng_e
+{
+  RNG_XORSHIFT = 0,         /* xorshift128+ (vectorized). */
+  RNG_RDRAND                /* Intel's RDRAND instruction. */
+};
+
+/* Pool of random words (one per worker), refilled all at once by
+   random_refill(). RANDOM() just takes the next one.
+   NOTE: 2 KiB, to stay on L1 cache. */
+#define RNG_POOL_WORDS 512
+
+typedef union
+{
+  uint64_t q[RNG_POOL_WORDS / 2];
+  uint32_t d[RNG_POOL_WORDS];
+} rng_pool_T;
+
+extern _Thread_local rng_pool_T rng_pool;
+extern _Thread_local unsigned int rng_next;
+
+extern uint32_t random_refill ( void );
+extern void random_fill ( void *, size_t );
+
+#define RANDOM() ( __builtin_expect ( rng_next < RNG_POOL_WORDS, 1 ) ? \
+                   rng_pool.d[rng_next++] : random_refill() )
+
+extern void SRANDOM ( uint64_t, unsigned int );
+extern uint64_t random_seed ( void );
+extern void select_rng ( int );
+extern _Bool rdrand_supported ( void );
 extern uint32_t NETMASK_RND ( uint32_t );
 
 #endif
@@ -0,0 +1,111 @@
+/* vim: set ts=2 et sw=2 : */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2014 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TEMPLATE_INCLUDED__
+#define __TEMPLATE_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <t50_config.h>
+#include <t50_memalloc.h>
+
+#define TEMPLATE_MAX_PATCHES  16
+#define TEMPLATE_MAX_CSUMS    4
+#define TEMPLATE_MAX_MIRRORS  3
+#define TEMPLATE_MAX_TERMS    24
+
+/* Where the value of a patched field comes from. */
+enum
+{
+  PATCH_RANDOM = 0,   /* RANDOM() */
+  PATCH_DADDR,        /* co->ip.daddr (already in network order) */
+  PATCH_SADDR,        /* co->ip.saddr (already in network order) */
+  PATCH_SPORT,        /* co->source (ports lists) */
+  PATCH_DPORT         /* co->dest (ports lists) */
+};
+
+/* How a checksum is computed. */
+enum
+{
+  CSUM_INET = 0,      /* htons ( cksum() ) */
+  CSUM_RAW,           /* cksum(), as is (GRE) */
+  CSUM_BOGUS          /* RANDOM() (--bogus-csum) */
+};
+
+/* A field changed on every packet. The same value may be written on
+   more than one place (ex: source address on IP and pseudo headers). */
+typedef struct
+{
+  uint16_t offset[TEMPLATE_MAX_MIRRORS];
+  uint8_t  count;     /* Number of offsets. */
+  uint8_t  width;     /* 1, 2 or 4 bytes. */
+  uint8_t  source;    /* PATCH_* */
+  uint32_t old;       /* Value on the image. */
+} patch_T;
+
+/* A field covered by a checksum: A patch or another checksum. */
+typedef struct
+{
+  uint8_t  index;     /* Patch or checksum index. */
+  uint8_t  is_csum;
+} term_T;
+
+/* A checksum recalculated on every packet.
+   It is updated from the value on the image, for every field changed on the
+   checksummed block (RFC 1624), unless it must be computed again (full). */
+typedef struct
+{
+  uint16_t offset;    /* Checksum field. */
+  uint16_t start;     /* Checksummed block. */
+  uint16_t length;
+  uint8_t  type;      /* CSUM_* */
+  _Bool    full;      /* Cannot be updated: Compute it again. */
+  uint16_t check;     /* Value on the image (as in memory). */
+  uint32_t base;      /* ~check and ~old of every term (RFC 1624). */
+  uint8_t  num_terms;
+  term_T   terms[TEMPLATE_MAX_TERMS];
+} csum_T;
+
+/* Prebuilt packet image. */
+typedef struct
+{
+  int           state;      /* 0 = not built yet, 1 = ok, -1 = not supported. */
+  void         *image;
+  size_t        size;
+  unsigned int  num_patches;
+  unsigned int  num_csums;
+  patch_T       patches[TEMPLATE_MAX_PATCHES];
+  csum_T        csums[TEMPLATE_MAX_CSUMS];    /* NOTE: Computed in this order. */
+} template_T;
+
+void     init_templates ( void );
+void     destroy_templates ( void );
+int      build_from_template ( unsigned int, const config_options_T * const restrict,
+                               packet_buffer_T * restrict, size_t * restrict );
+
+/* Used by modules template functions. */
+void     template_image ( template_T * restrict, const void * restrict, size_t );
+patch_T *template_add_patch ( template_T *, int, unsigned int, size_t );
+void     template_add_mirror ( patch_T *, size_t );
+void     template_add_cksum ( template_T *, int, size_t, size_t, size_t );
+void     template_add_ip ( template_T * restrict, const config_options_T * const restrict, size_t );
+void     template_add_gre_cksum ( template_T * restrict, const config_options_T * const restrict );
+
+#endif
@@ -0,0 +1,44 @@
+/* vim: set ts=2 et sw=2 : */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2014 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __WORKERS_INCLUDED__
+#define __WORKERS_INCLUDED__
+
+#include <stdint.h>
+#include <t50_typedefs.h>
+#include <t50_config.h>
+#include <t50_cidr.h>
+#include <t50_netio.h>
+#include <t50_pipeline.h>
+
+/* Index of the calling worker (0 for the first one). */
+extern _Thread_local unsigned int worker_id;
+
+void         run_workers ( const config_options_T * const restrict,
+                          const struct cidr * const restrict,
+                          const struct cidr * const restrict );
+void         get_statistics ( tx_stats_T * );
+unsigned int get_num_workers ( void );
+int          get_worker_statistics ( unsigned int, tx_stats_T * );
+unsigned int get_pipeline_statistics ( pipeline_stats_T * );
+uint64_t     get_pregen_time ( void );
+_Bool        check_cpu_list ( const char * );
+
+#endif
@@ -39,20 +39,21 @@
 #include <t50_netio.h>
 #include <t50_errors.h>
 #include <t50_cidr.h>
+#include <t50_targets.h>
+#include <t50_ports.h>
 #include <t50_memalloc.h>
 #include <t50_modules.h>
 #include <t50_randomizer.h>
 #include <t50_shuffle.h>
 #include <t50_help.h>
+#include <t50_workers.h>
 
-static pid_t pid = -1;                 /* -1 is a trick used when __HAVE_TURBO__ isn't defined. */
-static sig_atomic_t child_is_dead = 0; /* Used to kill child process if necessary. */
 static double t0;                      /* Used to calcualte time spent on T50. */
 static int echo_enabled = 1;
 
 _NOINLINE static void               initialize ( const config_options_T * );
-_NOINLINE static modules_table_T   *selectProtocol ( const config_options_T *restrict, int *restrict );
 static void                         show_statistics ( void );
+static void                         show_pipeline_statistics ( pid_t );
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -60,9 +61,7 @@ static void                         show_statistics ( void );
 int main ( int argc, char *argv[] )
 {
   config_options_T *co;
-  struct cidr      *cidr_ptr;
-  modules_table_T  *ptbl;
-  int              proto;
+  struct cidr      *cidr_ptr, *source_ptr;
   time_t           lt;
   struct timeval   tv;
 
@@ -74,50 +73,36 @@ int main ( int argc, char *argv[] )
      This must be called before testing user privileges. */
   co = parse_command_line ( argv );
 
+  /* Without --seed, the seed is random (but shown, to repeat the run). */
+  if ( ! co->seed_given )
+    co->seed = random_seed();
+
   /* If user don't have root privilege, abort. */
   if ( getuid() )
     fatal_error ( "User must have root privilege to run." );
 
+  /* Loads the target lists (--targets and --sources), if any. */
+  load_targets ( co );
+
+  /* Expands the ports lists (--sport and --dport), if any. */
+  load_ports ( co );
+
   initialize ( co );
-  create_socket();
 
   /* Calculates CIDR for destination address. */
   if ( ! ( cidr_ptr = config_cidr ( co ) ) )
     return EXIT_FAILURE;
 
-#ifdef  __HAVE_TURBO__
-
-  /* Creates the forked process only if turbo is turned on. */
-  if ( co->turbo )
-  {
-    if ( ( co->ip.protocol == IPPROTO_T50 && co->threshold > number_of_modules ) ||
-         ( co->ip.protocol != IPPROTO_T50 && co->threshold > 1 ) )
-    {
-      threshold_T new_threshold;
-
-      if ( ( pid = fork() ) == -1 )
-        fatal_error ( "Cannot create child process" );
-
-      /* Distribute the number of packets between processes */
-      new_threshold = co->threshold / 2;
-
-      if ( !IS_CHILD_PID ( pid ) )
-        new_threshold += ( co->threshold & 1 );
-
-      co->threshold = new_threshold;
-    }
-  }
-
-  printf ( INFO "PID=%u\n", getpid() );
-
-#endif  /* __HAVE_TURBO__ */
+  /* ... and for source addresses. */
+  if ( ! ( source_ptr = config_source_cidr ( co ) ) )
+    return EXIT_FAILURE;
 
   /* This process must have higher priority. */
   if ( setpriority ( PRIO_PROCESS, PRIO_PROCESS, -15 )  == -1 )
     fatal_error ( "Cannot set process priority" );
 
-  /* Show launch info only for parent process. */
-  if ( !IS_CHILD_PID ( pid ) && !co->quiet )
+  /* Show launch info. */
+  if ( !co->quiet )
   {
     lt = time ( NULL );
 
@@ -125,109 +110,22 @@ int main ( int argc, char *argv[] )
              ctime ( &lt ) );
   }
 
-  // SRANDOM is here because each process must have its own
-  // random seed.
-  SRANDOM();
-
-  // Initialize indices used for IPPROTO_T50 shuffling.
-  build_proto_indices();
-
-  /* Preallocate packet buffer.
-     Register deallocator after successful allocation. */
-  alloc_packet ( INITIAL_PACKET_SIZE );
-  atexit ( destroy_packet_buffer );
-
-  /* Selects the initial protocol. */
-  if ( co->ip.protocol != IPPROTO_T50 )
-    ptbl = selectProtocol ( co, &proto );
-  else
-  {
-    proto = co->ip.protocol;
-    shuffle ( indices, number_of_modules );   // do initial shuffle.
-                                              // this maybe NOT be used afterwards.
-    ptbl = &mod_table[get_proto_index ( co )];
-  }
-
   /* Used to calculate the time spent injecting packets */
   gettimeofday ( &tv, NULL );
   t0 = tv.tv_usec * 1e-6 + tv.tv_sec;
   atexit ( show_statistics );                 // Register show_statistics() if
                                               // we got to this point.
 
-  /* MAIN LOOP */
-  // OBS: flood means non stop injection.
-  //      threshold is the number of packets to inject.
-  while ( co->flood || co->threshold )
-  {
-    /* Will hold the actual packet size after module function call. */
-    size_t size;
-
-    /* Set the destination IP address to RANDOM IP address. */
-    co->ip.daddr = cidr_ptr->__1st_addr;
-
-    if ( cidr_ptr->hostid )
-      // cidr_ptr->hostid has bit 0=0. The remainder is always less
-      // then the divisor, so we need to add 1.
-      co->ip.daddr += RANDOM() % ( cidr_ptr->hostid + 1 );
-
-    co->ip.daddr = htonl ( co->ip.daddr );
-
-    /* Finally, calls the 'module' function to build the packet. */
-    co->ip.protocol = ptbl->protocol_id;
-    ptbl->func ( co, &size );
-
-    /* Try to send the packet. */
-    if ( ! send_packet ( packet, size, co ) )
-#ifndef NDEBUG
-      error ( "Packet for protocol %s (%zu bytes long) not sent", ptbl->name, size );
+  /* MAIN LOOP (on each worker) */
+  run_workers ( co, cidr_ptr, source_ptr );
 
-    /* continue trying to send other packets on debug mode! */
-#else
-      fatal_error ( "Unspecified error sending a packet" );
-#endif
-
-    /* If protocol is 'T50', then get the next true protocol. */
-    if ( proto == IPPROTO_T50 )
-      ptbl = &mod_table[get_proto_index ( co )];
-
-    /* Decrement the threshold only if not flooding! */
-    if ( !co->flood )
-      co->threshold--;
-  }
-
-  /* Show termination message only for parent process. */
-  if ( !IS_CHILD_PID ( pid ) )
+  /* Show termination message. */
+  if ( !co->quiet )
   {
-#ifdef __HAVE_TURBO__
-
-    // NOTE: Notice that for a single process pid will be -1! */
-    if ( pid > 0 )
-    {
-      // Don't do this if child process is already dead!
-      if ( !child_is_dead )
-      {
-        /* Wait 5 seconds for the child to end... */
-        alarm ( WAIT_FOR_CHILD_TIMEOUT );
-
-        /* NOTE: SIGALRM will kill the child process if necessary! */
-        wait ( NULL );
-        child_is_dead = 1;
-
-        alarm ( 0 );
-      }
-    }
-
-#endif
-
-    close_socket();
-
-    if ( !co->quiet )
-    {
-      lt = time ( NULL );
+    lt = time ( NULL );
 
-      printf ( INFO "" PACKAGE_NAME " successfully finished at %s\n",
-               ctime ( &lt ) );
-    }
+    printf ( INFO "" PACKAGE_NAME " successfully finished at %s\n",
+             ctime ( &lt ) );
   }
 
   /* Everything went well. Exit. */
@@ -238,20 +136,7 @@ int main ( int argc, char *argv[] )
 /* This function handles signal interrupts. */
 static void signal_handler ( int signal )
 {
-  /* NOTE: SIGALRM and SIGCHLD will happen only in parent process! */
-  switch ( signal )
-  {
-    case SIGALRM:
-      if ( !IS_CHILD_PID ( pid ) )
-        kill ( pid, SIGKILL );
-      return;
-
-    case SIGCHLD:
-      child_is_dead = 1;
-      return;
-  }
-
-  /* Every other signals will exit the process */
+  /* Every signal will exit the process */
 
   /* The shell documentation (bash) specifies that a process,
      when exits because a signal, must return 128+signal#. */
@@ -261,7 +146,7 @@ static void signal_handler ( int signal )
 void initialize ( const config_options_T *co )
 {
   /* 0 is an invalid signal! (marks the end of the list) */
-  int handled_signals[] = { SIGPIPE, SIGINT, SIGCHLD, SIGALRM, 0 };
+  int handled_signals[] = { SIGPIPE, SIGINT, SIGTERM, 0 };
   int *sigsp;
 
   /* allows libc calls to restart after a signal! */
@@ -270,6 +155,8 @@ void initialize ( const config_options_T *co )
 
   struct termios tios;
 
+  select_rng ( co->rng );
+
   /* Hide ^X char output from terminal */
   tcgetattr ( STDOUT_FILENO, &tios );
   echo_enabled = tios.c_lflag & ECHO;
@@ -315,30 +202,30 @@ void initialize ( const config_options_T *co )
 
 #endif
 
-    if ( co->bits )
-      puts ( INFO "Performing stress testing..." );
+    if ( co->workers > 1 )
+      printf ( INFO "Using %u workers...\n", co->workers );
 
-    puts ( INFO "Hit Ctrl+C to stop..." );
-  }
-}
+    if ( co->pipeline )
+      printf ( INFO "Pipeline: %u builder(s) per worker, rings of %u slots (%u bytes)...\n",
+               co->builders, co->ring_depth, co->ring_slot );
 
-/* Selects the initial protocol based on the configuration. */
-modules_table_T *selectProtocol ( const config_options_T *restrict co, int *restrict proto )
-{
-  modules_table_T *ptbl;
+    if ( co->pregen )
+      printf ( INFO "Pre-generating %u packets...\n", co->pregen );
 
-  ptbl = mod_table;
+    if ( co->bits )
+      puts ( INFO "Performing stress testing..." );
 
-  // FIXME: Of course this is a 'hack'. Maybe I should divise something more portable here.
-  if ( ( *proto = co->ip.protocol ) != IPPROTO_T50 )
-    ptbl += co->ip.protoname;
+    if ( co->rng == RNG_XORSHIFT )
+      printf ( INFO "Random seed: %" PRIu64 "\n", co->seed );
 
-  return ptbl;
+    puts ( INFO "Hit Ctrl+C to stop..." );
+  }
 }
 
 void show_statistics ( void )
 {
   struct timeval tv;
+  tx_stats_T stats;
 
   // FIXME: This is not as precise as I wanted.
   //        A bunch of microseconds (maybe milisseconds) will
@@ -348,23 +235,90 @@ void show_statistics ( void )
 
   close_socket(); // NOTE: This will 'flush' the buffers?!
 
-  if ( packets_sent )
+  /* Sums up the statistics of all workers. */
+  get_statistics ( &stats );
+
+  if ( stats.packets_sent || stats.packets_dropped )
   {
     pid_t pid;
     double t1;
 
     t1 = tv.tv_usec * 1e-6 + tv.tv_sec;
 
+    /* Building the corpus (--pregen) isn't injecting. */
+    t1 -= get_pregen_time() * 1e-9;
+
     pid = getpid();
     printf ( INFO "(PID:%1$u) packets:    %2$" PRIu64 " (%3$" PRIu64 " bytes sent).\n"
-             INFO "(PID:%1$u) throughput: %4$.2f packets/second.\n",
+             INFO "(PID:%1$u) throughput: %4$.2f packets/second.\n"
+             INFO "(PID:%1$u) backpressure: %5$" PRIu64 " retries, %6$" PRIu64 " drops, "
+             "%7$" PRIu64 " waits (%8$.3f seconds blocked).\n",
              pid,
-             packets_sent,
-             bytes_sent,
-             ( double ) packets_sent / ( t1 - t0 ) );
+             stats.packets_sent,
+             stats.bytes_sent,
+             ( double ) stats.packets_sent / ( t1 - t0 ),
+             stats.send_retries,
+             stats.packets_dropped,
+             stats.io_waits,
+             stats.blocked_time * 1e-9 );
+
+    show_pipeline_statistics ( pid );
+
+    if ( get_pregen_time() )
+      printf ( INFO "(PID:%u) corpus: built in %.3f seconds (not accounted on throughput).\n",
+               pid, get_pregen_time() * 1e-9 );
+
+    /* Per worker breakdown, to make imbalances visible. */
+    if ( get_num_workers() > 1 )
+    {
+      char cpu[16];
+      unsigned int i;
+      int n;
+
+      i = 0;
+      while ( i < get_num_workers() )
+      {
+        if ( ( n = get_worker_statistics ( i, &stats ) ) < 0 )
+          strcpy ( cpu, "any" );
+        else
+          snprintf ( cpu, sizeof cpu, "%d", n );
+
+        printf ( INFO "(PID:%u) worker #%u (CPU %s): %" PRIu64 " packets, %.2f packets/second, "
+                 "%" PRIu64 " retries, %" PRIu64 " drops.\n",
+                 pid, i, cpu,
+                 stats.packets_sent,
+                 ( double ) stats.packets_sent / ( t1 - t0 ),
+                 stats.send_retries,
+                 stats.packets_dropped );
+
+        i++;
+      }
+    }
   }
 }
 
+/* Ring occupancy shows which stage is the bottleneck: Full rings mean the
+   sender can't keep up with the builders; empty ones, the other way around. */
+static void show_pipeline_statistics ( pid_t pid )
+{
+  pipeline_stats_T ps;
+  double occupancy;
+
+  if ( ! get_pipeline_statistics ( &ps ) || ! ps.polls )
+    return;
+
+  occupancy = 100.0 * ps.occupancy / ps.polls / ps.depth;
+
+  printf ( INFO "(PID:%1$u) pipeline: %2$.1f%% average ring occupancy, %3$" PRIu64 " waits on full rings, "
+           "%4$" PRIu64 " of %5$" PRIu64 " polls on empty rings (bottleneck: %6$s).\n",
+           pid,
+           occupancy,
+           ps.full,
+           ps.empty,
+           ps.polls,
+           occupancy > 50.0 ? "sender" : "builders" );
+}
+
 _FINI static void dtor ( void )
 {
   struct termios tios;
@@ -18,46 +18,178 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+/* Packet buffers arena.
+
+   Every worker has its own arena: A slab of cache line aligned slots for
+   each size class (2 kB, 4 kB, ... 64 kB), each one with room for the
+   packets the worker may have in flight (the transmit batch, plus the one
+   being built). A slab is allocated on the first use of its class and
+   slots are taken from (and given back to) a stack of free indexes, so
+   malloc() isn't called after the first packets.
+
+   Modules build the packets on the buffer they are given (packet_buffer_T),
+   calling packet_reserve() to make sure it is big enough: Arena slots are
+   swapped for a slot of a bigger class; external buffers (transmit slots,
+   pipeline rings) cannot grow. */
+
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <t50_defines.h>
 #include <t50_errors.h>
+#include <t50_memalloc.h>
+
+#define PACKET_CLASSES    6                      /* 2 kB to 64 kB. */
+#define CLASS_SIZE(c)     ( ( size_t ) INITIAL_PACKET_SIZE << ( c ) )
+
+typedef struct
+{
+  uint8_t  *slots;      /* NULL until the first use. */
+  uint32_t *free;       /* Stack of free slots indexes. */
+  uint32_t  nfree;
+} slab_T;
+
+/* NOTE: Every worker has its own arena. */
+static _Thread_local slab_T   slabs[PACKET_CLASSES];
+static _Thread_local uint32_t arena_depth = 0;
+
+/**
+ * Initializes the arena of the calling thread.
+ *
+ * @param depth Number of packets which may be in flight (slots per class).
+ */
+void init_packet_arena ( unsigned int depth )
+{
+  assert ( depth );
+
+  memset ( slabs, 0, sizeof slabs );
+  arena_depth = depth;
+}
+
+void destroy_packet_arena ( void )
+{
+  int c;
+
+  c = 0;
+  while ( c < PACKET_CLASSES )
+  {
+    SAFE_FREE ( slabs[c].slots );
+    SAFE_FREE ( slabs[c].free );
+    slabs[c].nfree = 0;
+    c++;
+  }
+}
+
+/* Gets the smallest class for 'size' bytes (-1 if it is too big). */
+static int size_class ( size_t size )
+{
+  int c;
+
+  c = 0;
+  while ( CLASS_SIZE ( c ) < size )
+    if ( ++c == PACKET_CLASSES )
+      return -1;
+
+  return c;
+}
+
+static void *slab_alloc ( int c )
+{
+  slab_T *s = &slabs[c];
+  uint32_t i;
+
+  /* NOTE: Assume the slab exists the majority of time. */
+  if ( ! s->slots )
+  {
+    if ( posix_memalign ( ( void ** ) &s->slots, CACHE_LINE_SIZE, arena_depth * CLASS_SIZE ( c ) ) ||
+         ! ( s->free = malloc ( arena_depth * sizeof *s->free ) ) )
+      fatal_error ( "Cannot allocate packet buffers (%u of %zu bytes).", arena_depth, CLASS_SIZE ( c ) );
 
-void  *packet = NULL;                   /* Actual packet buffer. Allocated dynamically. */
-static size_t current_packet_size = 0;  /* Used by alloc_packet(). */
+    /* Lower slots on the top of the stack. */
+    i = arena_depth;
+    while ( i )
+      s->free[s->nfree++] = --i;
+  }
+
+  if ( ! s->nfree )
+    fatal_error ( "No free packet buffers (more than %u packets in flight).", arena_depth );
+
+  return s->slots + s->free[--s->nfree] * CLASS_SIZE ( c );
+}
 
 /**
- * Preallocates the packet buffer.
+ * Gets a buffer from the arena.
  *
- * The function will reallocate memory only if the buffer isn't big enough to acomodate
- * new_packet_size bytes. Using IPPROTO_T50, after the first 'round', the buffer will be
- * big enough to accomodate all packets and no reallocations will be made.
+ * @param pb Pointer to the buffer descriptor.
+ * @param size Minimum size of the buffer.
+ */
+void packet_get ( packet_buffer_T *pb, size_t size )
+{
+  int c;
+
+  if ( ( c = size_class ( size ) ) < 0 )
+    fatal_error ( "Packet (%zu bytes) is too big.", size );
+
+  pb->data = slab_alloc ( c );
+  pb->size = CLASS_SIZE ( c );
+  pb->class_ = c;
+}
+
+/**
+ * Uses an external buffer (transmit slot, pipeline ring slot...).
  *
- * @param size Size of the new 'global' packet buffer.
+ * @param pb Pointer to the buffer descriptor.
+ * @param buffer Pointer to the buffer.
+ * @param size Size of the buffer.
  */
-void alloc_packet ( size_t new_packet_size )
+void packet_wrap ( packet_buffer_T *pb, void *buffer, size_t size )
 {
-  void *p;
+  pb->data = buffer;
+  pb->size = size;
+  pb->class_ = -1;
+}
 
-  assert( new_packet_size );
+/* Gives the buffer back to the arena (if it came from there). */
+void packet_put ( packet_buffer_T *pb )
+{
+  slab_T *s;
 
-  /* Realloc only ig the new packet size is greater than the old. */
-  /* NOTE: Assume the condition is false the majority of time. */
-  if ( new_packet_size > current_packet_size )
+  if ( pb->class_ >= 0 )
   {
-    /* Tries to reallocate memory. */
-    /* NOTE: Assume realloc will not fail. */
-    if ( ! ( p = realloc ( packet, new_packet_size ) ) )
-      fatal_error ( "Error reallocating packet buffer." );
-
-    /* Only assign a new pointer if successfull */
-    packet = p;
-    current_packet_size = new_packet_size;
+    s = &slabs[pb->class_];
+    s->free[s->nfree++] = ( ( uint8_t * ) pb->data - s->slots ) / CLASS_SIZE ( pb->class_ );
   }
+
+  pb->data = NULL;
+  pb->size = 0;
+  pb->class_ = -1;
 }
 
-void destroy_packet_buffer ( void )
+/**
+ * Makes sure the buffer has room for the packet.
+ *
+ * Called by the modules before building the packet (the contents are
+ * not kept if the buffer is replaced).
+ *
+ * @param pb Pointer to the buffer descriptor.
+ * @param size Size of the packet.
+ * @return Pointer to the buffer.
+ */
+void *packet_reserve ( packet_buffer_T *pb, size_t size )
 {
-  SAFE_FREE ( packet );
+  assert ( size );
+
+  /* NOTE: Assume the buffer is big enough the majority of time. */
+  if ( size > pb->size )
+  {
+    /* A transmit slot cannot grow! */
+    if ( pb->class_ < 0 )
+      fatal_error ( "Packet (%zu bytes) is too big for the transmit slot.", size );
+
+    packet_put ( pb );
+    packet_get ( pb, size );
+  }
+
+  return pb->data;
 }
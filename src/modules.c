@@ -137,12 +137,14 @@ VALID_OPTIONS_TABLE ( ospf, OPTION_ENCAPSULATED, OPTION_BOGUSCSUM, OPTION_SOURCE
   change the Makefile, add a MODULE_ENTRY, modify config.c and usage.c and compile. That's it! */
 BEGIN_MODULES_TABLE
 /* ( proto, name, description, function ) */
-MODULE_ENTRY ( IPPROTO_ICMP,  "ICMP",   "Internet Control Message Protocol",          icmp )
+/* NOTE: MODULE_ENTRY_TEMPLATE for modules with a template function (see template.c)
+         and MODULE_ENTRY_BATCH for modules with a batch function, too. */
+MODULE_ENTRY_TEMPLATE ( IPPROTO_ICMP,  "ICMP",   "Internet Control Message Protocol",  icmp )
 MODULE_ENTRY ( IPPROTO_IGMP,  "IGMPv1", "Internet Group Message Protocol v1",         igmpv1 )
 MODULE_ENTRY ( IPPROTO_IGMP,  "IGMPv3", "Internet Group Message Protocol v3",         igmpv3 )
-MODULE_ENTRY ( IPPROTO_TCP,   "TCP",    "Transmission Control Protocol",              tcp )
+MODULE_ENTRY_BATCH ( IPPROTO_TCP,   "TCP",    "Transmission Control Protocol",         tcp )
 MODULE_ENTRY ( IPPROTO_EGP,   "EGP",    "Exterior Gateway Protocol",                  egp )
-MODULE_ENTRY ( IPPROTO_UDP,   "UDP",    "User Datagram Protocol",                     udp )
+MODULE_ENTRY_BATCH ( IPPROTO_UDP,   "UDP",    "User Datagram Protocol",                udp )
 MODULE_ENTRY ( IPPROTO_UDP,   "RIPv1",  "Routing Internet Protocol v1",               ripv1 )
 MODULE_ENTRY ( IPPROTO_UDP,   "RIPv2",  "Routing Internet Protocol v2",               ripv2 )
 MODULE_ENTRY ( IPPROTO_DCCP,  "DCCP",   "Datagram Congestion Control Protocol",       dccp )
@@ -156,9 +158,10 @@ END_MODULES_TABLE
 #define NUM_OF_MODULES ((sizeof mod_table / sizeof mod_table[0])-1)
 
 const uint32_t number_of_modules = NUM_OF_MODULES;
-uint32_t indices[NUM_OF_MODULES];
+/* NOTE: Each worker shuffles its own indices. */
+_Thread_local uint32_t indices[NUM_OF_MODULES];
 
-static uint32_t next_index = 0;
+static _Thread_local uint32_t next_index = 0;
 
 int *get_module_valid_options_list ( int protocol )
 {
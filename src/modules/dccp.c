@@ -36,9 +36,10 @@
  * This function configures and sends the DCCP packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void dccp ( const config_options_T *const restrict co, size_t *restrict size )
+void dccp ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t length,
          dccp_length, /* DCCP header length. */
@@ -47,6 +48,8 @@ void dccp ( const config_options_T *const restrict co, size_t *restrict size )
   /* Packet and Checksum. */
   void *buffer_ptr;
 
+  void *packet;
+
   struct iphdr *ip;
 
   /* GRE Encapsulated IP Header. */
@@ -76,8 +79,8 @@ void dccp ( const config_options_T *const restrict co, size_t *restrict size )
           dccp_length             +
           length;
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -37,9 +37,10 @@ static size_t eigrp_hdr_len ( const uint16_t, const uint16_t, const uint8_t, con
  * This function configures and sends the EIGRP packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void eigrp ( const config_options_T *const restrict co, size_t *restrict size )
+void eigrp ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t length,
          eigrp_tlv_len; /* EIGRP TLV size. */
@@ -50,6 +51,8 @@ void eigrp ( const config_options_T *const restrict co, size_t *restrict size )
   /* Packet and Checksum. */
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr *ip;
   struct eigrp_hdr *eigrp;
 
@@ -65,8 +68,8 @@ void eigrp ( const config_options_T *const restrict co, size_t *restrict size )
           length                   +
           8;    /* FIXME: Ugly workaround! Must change this later! */
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -164,10 +167,8 @@ void eigrp ( const config_options_T *const restrict co, size_t *restrict size )
       /*
        * The Authentication key uses HMAC-MD5 or HMAC-SHA-1 digest.
        */
-      counter = 0;
-
-      while ( counter++ < stemp )
-        *buffer.byte_ptr++ = RANDOM();
+      random_fill ( buffer.ptr, stemp );
+      buffer.byte_ptr += stemp;
     }
   }
 
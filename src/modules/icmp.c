@@ -28,6 +28,7 @@
 #include <t50_memalloc.h>
 #include <t50_modules.h>
 #include <t50_randomizer.h>
+#include <t50_template.h>
 
 /**
  * ICMP packet header configuration.
@@ -35,12 +36,15 @@
  * This function configures and sends the ICMP packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void icmp ( const config_options_T *const restrict co, size_t *restrict size )
+void icmp ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t greoptlen;   /* GRE options size. */
 
+  void *packet;
+
   struct iphdr *ip;
 
   /* ICMP header. */
@@ -53,8 +57,8 @@ void icmp ( const config_options_T *const restrict co, size_t *restrict size )
           sizeof ( struct icmphdr ) +
           greoptlen;
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -88,3 +92,51 @@ void icmp ( const config_options_T *const restrict co, size_t *restrict size )
   /* GRE Encapsulation takes place. */
   gre_checksum ( packet, co, *size );
 }
+
+/**
+ * ICMP packet template.
+ *
+ * Builds the packet once and marks the fields changed on every packet.
+ *
+ * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the image is built.
+ * @param t Pointer to the template.
+ * @return true (always supported).
+ */
+int icmp_template ( const config_options_T * const restrict co,
+                   packet_buffer_T * restrict pb,
+                   template_T * restrict t )
+{
+  size_t size, offset;
+
+  icmp ( co, pb, &size );
+  template_image ( t, pb->data, size );
+
+  offset = sizeof ( struct iphdr ) + gre_opt_len ( co );
+
+  template_add_ip ( t, co, 0 );
+
+  /* Redirect gateway takes the place of id and sequence. */
+  if ( co->icmp.type == ICMP_REDIRECT &&
+       ( co->icmp.code == ICMP_REDIR_HOST || co->icmp.code == ICMP_REDIR_NET ) )
+  {
+    if ( !co->icmp.gateway )
+      template_add_patch ( t, PATCH_RANDOM, 4, offset + offsetof ( struct icmphdr, un.gateway ) );
+  }
+  else
+  {
+    if ( !co->icmp.id )
+      template_add_patch ( t, PATCH_RANDOM, 2, offset + offsetof ( struct icmphdr, un.echo.id ) );
+
+    if ( !co->icmp.sequence )
+      template_add_patch ( t, PATCH_RANDOM, 2, offset + offsetof ( struct icmphdr, un.echo.sequence ) );
+  }
+
+  template_add_cksum ( t, co->bogus_csum ? CSUM_BOGUS : CSUM_INET,
+                       offset + offsetof ( struct icmphdr, checksum ),
+                       offset, sizeof ( struct icmphdr ) );
+
+  template_add_gre_cksum ( t, co );
+
+  return 1;
+}
@@ -36,11 +36,14 @@
  * This function configures and sends the IGMPv1 packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void igmpv1 ( const config_options_T *const restrict co, size_t *restrict size )
+void igmpv1 ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t length;
+  void *packet;
+
   struct iphdr *ip;
 
   /* IGMPv1 header. */
@@ -56,8 +59,8 @@ void igmpv1 ( const config_options_T *const restrict co, size_t *restrict size )
           sizeof ( struct igmphdr ) +
           length;
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -36,15 +36,18 @@
  * This function configures and sends the IGMPv3 packet header.
  *
  * @para co Pointer to T50 configuration structure.
+ * @para pb Pointer to the buffer where the packet is built.
  * @para size Pointer to packet size (updated by the function).
  */
-void igmpv3 ( const config_options_T *const restrict co, size_t *restrict size )
+void igmpv3 ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t length;
 
   /* Packet and Checksum. */
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr *ip;
 
   /* IGMPv3 Query header, IGMPv3 Report header and IGMPv3 GREC header. */
@@ -59,8 +62,8 @@ void igmpv3 ( const config_options_T *const restrict co, size_t *restrict size )
           length            +
           igmpv3_hdr_len ( co->igmp.type, co->igmp.sources );
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -35,20 +35,22 @@
  * This function configures and sends the IPSec packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void ipsec ( const config_options_T *const restrict co, size_t *size )
+void ipsec ( const config_options_T *const restrict co, packet_buffer_T *pb, size_t *size )
 {
   /* IPSec AH Integrity Check Value (ICV). */
 #define IP_AH_ICV (sizeof(uint32_t) * 3)
 
   size_t length,
-         esp_data,    /* IPSec ESP Data Encrypted (RANDOM). */
-         counter;
+         esp_data;    /* IPSec ESP Data Encrypted (RANDOM). */
 
   /* Packet. */
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr *ip;
 
   /* IPSec AH header and IPSec ESP Header. */
@@ -66,8 +68,8 @@ void ipsec ( const config_options_T *const restrict co, size_t *size )
           IP_AH_ICV                  +
           esp_data;
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   ip = ip_header ( packet, *size, co );
 
@@ -113,10 +115,8 @@ void ipsec ( const config_options_T *const restrict co, size_t *size )
   buffer.ptr = ip_auth + 1;
 
   /* Setting a fake encrypted content. */
-  counter = 0;
-
-  while ( counter++ < IP_AH_ICV )
-    *buffer.byte_ptr++ = RANDOM();
+  random_fill ( buffer.ptr, IP_AH_ICV );
+  buffer.byte_ptr += IP_AH_ICV;
 
   /* IPSec ESP Header structure making a pointer to Checksum. */
   ip_esp         = buffer.ptr;
@@ -126,10 +126,8 @@ void ipsec ( const config_options_T *const restrict co, size_t *size )
   buffer.ptr = ip_esp + 1;
 
   /* Setting a fake encrypted content. */
-  counter = 0;
-
-  while ( counter++ < esp_data )
-    *buffer.byte_ptr++ = RANDOM();
+  random_fill ( buffer.ptr, esp_data );
+  buffer.byte_ptr += esp_data;
 
   /* GRE Encapsulation takes place. */
   gre_checksum ( packet, co, *size );
@@ -38,9 +38,10 @@ static void ospf_lsupdate ( const config_options_T *const restrict, void **restr
  * This function configures and sends the OSPF packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void ospf ( const config_options_T *const restrict co, size_t *restrict size )
+void ospf ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t length,
          ospf_length, /* OSPF header length. */
@@ -53,6 +54,8 @@ void ospf ( const config_options_T *const restrict co, size_t *restrict size )
   /* Packet and Checksum. */
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr *ip;
   struct ospf_hdr *ospf;
 
@@ -79,8 +82,8 @@ void ospf ( const config_options_T *const restrict co, size_t *restrict size )
           auth_hmac_md5_len ( co->ospf.auth ) +
           ospf_tlv_len ( co->ospf.type, lls, co->ospf.auth );
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -394,10 +397,8 @@ build_ospf_lsupdate:
   stemp = auth_hmac_md5_len ( co->ospf.auth );
 
   /* NOTE: Assume stemp > 0. */
-  counter = 0;
-
-  while ( counter++ < stemp )
-    *buffer.byte_ptr++ = RANDOM();
+  random_fill ( buffer.ptr, stemp );
+  buffer.byte_ptr += stemp;
 
   /*
    * OSPF Link-Local Signaling (RFC 5613)
@@ -486,10 +487,8 @@ build_ospf_lsupdate:
         stemp = auth_hmac_md5_len ( co->ospf.auth );
 
         /* NOTE: Assume stemp > 0. */
-        counter = 0;
-
-        while ( counter++ < stemp )
-          *buffer.byte_ptr++ = RANDOM();
+        random_fill ( buffer.ptr, stemp );
+        buffer.byte_ptr += stemp;
 
         /*
          * OSPF Link-Local Signaling (RFC 5613)
@@ -38,14 +38,17 @@
  * This function configures and sends the RIPv1 packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void ripv1 ( const config_options_T *const restrict co, size_t *restrict size )
+void ripv1 ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t length;
 
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr *ip;
   struct iphdr *gre_ip;
   struct udphdr *udp;
@@ -60,8 +63,8 @@ void ripv1 ( const config_options_T *const restrict co, size_t *restrict size )
           length             +
           rip_hdr_len ( 0 );
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
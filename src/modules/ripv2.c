@@ -38,15 +38,18 @@
  * This function configures and sends the RIPv2 packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void ripv2 ( const config_options_T *const restrict co, size_t *restrict size )
+void ripv2 ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t greoptlen,     /* GRE options size. */
          length;
 
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr  *ip;
   struct iphdr  *gre_ip;
   struct udphdr *udp;
@@ -61,8 +64,8 @@ void ripv2 ( const config_options_T *const restrict co, size_t *restrict size )
           greoptlen             +
           rip_hdr_len ( co->rip.auth );
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -225,7 +228,7 @@ void ripv2 ( const config_options_T *const restrict co, size_t *restrict size )
    */
   if ( co->rip.auth )
   {
-    uint32_t size, counter;
+    uint32_t size;
 
     *buffer.word_ptr++ = 0xffffU;
     *buffer.word_ptr++ = htons ( 1 );
@@ -236,10 +239,8 @@ void ripv2 ( const config_options_T *const restrict co, size_t *restrict size )
     size = auth_hmac_md5_len ( co->rip.auth );
 
     /* NOTE: Assume size > 0. */
-    counter = 0;
-
-    while ( counter++ < size )
-      *buffer.byte_ptr++ = RANDOM();
+    random_fill ( buffer.ptr, size );
+    buffer.byte_ptr += size;
   }
 
   /* PSEUDO Header structure making a pointer to Checksum. */
@@ -37,9 +37,10 @@ static size_t rsvp_objects_len ( const uint8_t, const uint8_t, const uint8_t, co
  * This function configures and sends the RSVP packet header.
  *
  * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
  * @param size Pointer to packet size (updated by the function).
  */
-void rsvp ( const config_options_T *const restrict co, size_t *restrict size )
+void rsvp ( const config_options_T *const restrict co, packet_buffer_T *restrict pb, size_t *restrict size )
 {
   size_t greoptlen,       /* GRE options size. */
          objects_length;  /* RSVP objects length. */
@@ -47,6 +48,8 @@ void rsvp ( const config_options_T *const restrict co, size_t *restrict size )
   /* Packet and Checksum. */
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr *ip;
 
   /* RSVP Common header. */
@@ -62,8 +65,8 @@ void rsvp ( const config_options_T *const restrict co, size_t *restrict size )
           greoptlen                      +
           objects_length;
 
-  /* Try to reallocate the packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
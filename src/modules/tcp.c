@@ -31,22 +31,49 @@
 #include <t50_memalloc.h>
 #include <t50_modules.h>
 #include <t50_randomizer.h>
+#include <t50_template.h>
 
 /*
  * prototypes.
  */
 static size_t tcp_options_len ( const uint8_t, int, int );
 
-/**
- * TCP packet header configuration.
- *
- * Configures the TCP packet header.
- * A pointer to this function will be on modules table.
- *
- * @param co Pointer to T50 configuration structure.
- * @param size Pointer to size of the packet (updated by the function).
- */
-void tcp ( const config_options_T * const restrict co, size_t * restrict size )
+/* What is the same on every packet (see tcp_batch()). */
+typedef struct
+{
+  size_t   greoptlen;   /* GRE options size. */
+  uint32_t tcpolen,     /* TCP options size. */
+           tcpopt;      /* TCP options total size. */
+  size_t   size;        /* Packet size. */
+} tcp_layout_T;
+
+static void tcp_layout ( const config_options_T * const restrict co, tcp_layout_T * restrict l )
+{
+  l->greoptlen = gre_opt_len ( co );
+  l->tcpolen = tcp_options_len ( co->tcp.options, co->tcp.md5, co->tcp.auth );
+  l->tcpopt = l->tcpolen + TCPOLEN_PADDING ( l->tcpolen );
+
+  l->size = sizeof ( struct iphdr )  +
+            sizeof ( struct tcphdr ) +
+            sizeof ( struct psdhdr ) +
+            l->tcpopt                +
+            l->greoptlen;
+
+  /*
+   * The RFC 793 has defined a 4-bit field in the TCP header which encodes the size
+   * of the header in 4-byte words.  Thus the maximum header size is 15*4=60 bytes.
+   * Of this, 20 bytes are taken up by non-options fields of the TCP header,  which
+   * leaves 40 bytes (TCP header * 2) for options.
+   */
+  if ( l->tcpopt > ( sizeof ( struct tcphdr ) * 2 ) )
+    fatal_error ( "%s() - TCP option size (%u bytes) is bigger than two times the TCP header size.",
+                  __FUNCTION__, l->tcpopt );
+}
+
+static void tcp_build ( const config_options_T * const restrict co,
+                        const tcp_layout_T * restrict l,
+                        packet_buffer_T * restrict pb,
+                        size_t * restrict size )
 {
   uint32_t tcpolen,     /* TCP options size. */
            tcpopt;      /* TCP options total size. */
@@ -54,6 +81,8 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
 
   memptr_T buffer;
 
+  void *packet;
+
   struct iphdr *ip;
 
   /* GRE Encapsulated IP Header. */
@@ -63,20 +92,13 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
   struct tcphdr *tcp;
   struct psdhdr *pseudo;
 
-  assert ( co != NULL );
-
-  length = gre_opt_len ( co );
-  tcpolen = tcp_options_len ( co->tcp.options, co->tcp.md5, co->tcp.auth );
-  tcpopt = tcpolen + TCPOLEN_PADDING ( tcpolen );
+  length = l->greoptlen;
+  tcpolen = l->tcpolen;
+  tcpopt = l->tcpopt;
+  *size = l->size;
 
-  *size = sizeof ( struct iphdr )  +
-          sizeof ( struct tcphdr ) +
-          sizeof ( struct psdhdr ) +
-          tcpopt                   +
-          length;
-
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* IP Header structure making a pointer to Packet. */
   ip = ip_header ( packet, *size, co );
@@ -86,16 +108,6 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
                                sizeof ( struct tcphdr ) +
                                tcpopt );
 
-  /*
-   * The RFC 793 has defined a 4-bit field in the TCP header which encodes the size
-   * of the header in 4-byte words.  Thus the maximum header size is 15*4=60 bytes.
-   * Of this, 20 bytes are taken up by non-options fields of the TCP header,  which
-   * leaves 40 bytes (TCP header * 2) for options.
-   */
-  if ( tcpopt > ( sizeof ( struct tcphdr ) * 2 ) )
-    fatal_error ( "%s() - TCP option size (%zu bytes) is bigger than two times the TCP header size.",
-                  __FUNCTION__, tcpopt );
-
   /* TCP Header structure making a pointer to IP Header structure. */
   tcp          = ( void * ) ( ip + 1 ) + length;
   tcp->source  = IPPORT_RND ( co->source );
@@ -389,7 +401,7 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
    */
   if ( co->tcp.md5 )
   {
-    uint32_t stemp, counter;
+    uint32_t stemp;
 
     *buffer.byte_ptr++ = TCPOPT_MD5;
     *buffer.byte_ptr++ = TCPOLEN_MD5;
@@ -399,9 +411,8 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
     stemp = auth_hmac_md5_len ( co->tcp.md5 );
 
     /* NOTE: Assume stemp > 0. */
-    counter = 0;
-    while ( counter++ < stemp )
-      *buffer.byte_ptr++ = RANDOM();
+    random_fill ( buffer.ptr, stemp );
+    buffer.byte_ptr += stemp;
   }
 
   /*
@@ -427,7 +438,7 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
    */
   if ( co->tcp.auth )
   {
-    uint32_t stemp, counter;
+    uint32_t stemp;
 
     *buffer.byte_ptr++ = TCPOPT_AO;
     *buffer.byte_ptr++ = TCPOLEN_AO;
@@ -439,9 +450,8 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
     stemp = auth_hmac_md5_len ( co->tcp.auth );
 
     /* NOTE: Assume stemp > 0. */
-    counter = 0;
-    while ( counter++ < stemp )
-      *buffer.byte_ptr++ = RANDOM();
+    random_fill ( buffer.ptr, stemp );
+    buffer.byte_ptr += stemp;
   }
 
   /* Padding the TCP Options. */
@@ -482,6 +492,117 @@ void tcp ( const config_options_T * const restrict co, size_t * restrict size )
   gre_checksum ( packet, co, *size );
 }
 
+/**
+ * TCP packet header configuration.
+ *
+ * Configures the TCP packet header.
+ * A pointer to this function will be on modules table.
+ *
+ * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
+ * @param size Pointer to size of the packet (updated by the function).
+ */
+void tcp ( const config_options_T * const restrict co, packet_buffer_T * restrict pb, size_t * restrict size )
+{
+  tcp_layout_T l;
+
+  assert ( co != NULL );
+
+  tcp_layout ( co, &l );
+  tcp_build ( co, &l, pb, size );
+}
+
+/**
+ * Builds a batch of TCP packets.
+ *
+ * The options layout is worked out once, for all of them.
+ *
+ * @param co Pointer to T50 configuration structure (addresses and ports
+ *           are changed).
+ * @param vars Addresses and ports of each packet.
+ * @param pbs Buffers where the packets are built.
+ * @param sizes Sizes of the packets (updated by the function).
+ * @param count Number of packets.
+ */
+void tcp_batch ( config_options_T * const restrict co,
+                 const packet_vars_T * restrict vars,
+                 packet_buffer_T * restrict pbs,
+                 size_t * restrict sizes,
+                 unsigned int count )
+{
+  tcp_layout_T l;
+  unsigned int i;
+
+  assert ( co != NULL );
+
+  tcp_layout ( co, &l );
+
+  i = 0;
+  while ( i < count )
+  {
+    set_packet_vars ( co, &vars[i] );
+    tcp_build ( co, &l, &pbs[i], &sizes[i] );
+    i++;
+  }
+}
+
+/**
+ * TCP packet template.
+ *
+ * Builds the packet once and marks the fields changed on every packet.
+ * TCP options aren't supported (most of them have random fields and
+ * change other header fields).
+ *
+ * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the image is built.
+ * @param t Pointer to the template.
+ * @return true if supported, false otherwise.
+ */
+int tcp_template ( const config_options_T * const restrict co,
+                  packet_buffer_T * restrict pb,
+                  template_T * restrict t )
+{
+  size_t size, offset;
+
+  if ( co->tcp.options || co->tcp.md5 || co->tcp.auth )
+    return 0;
+
+  tcp ( co, pb, &size );
+  template_image ( t, pb->data, size );
+
+  offset = sizeof ( struct iphdr ) + gre_opt_len ( co );
+
+  template_add_ip ( t, co, offset + sizeof ( struct tcphdr ) );
+
+  if ( !co->source || co->sports )
+    template_add_patch ( t, co->sports ? PATCH_SPORT : PATCH_RANDOM, 2,
+                         offset + offsetof ( struct tcphdr, source ) );
+
+  if ( !co->dest || co->dports )
+    template_add_patch ( t, co->dports ? PATCH_DPORT : PATCH_RANDOM, 2,
+                         offset + offsetof ( struct tcphdr, dest ) );
+
+  if ( co->tcp.syn && !co->tcp.sequence )
+    template_add_patch ( t, PATCH_RANDOM, 4, offset + offsetof ( struct tcphdr, seq ) );
+
+  if ( co->tcp.ack && !co->tcp.acknowledge )
+    template_add_patch ( t, PATCH_RANDOM, 4, offset + offsetof ( struct tcphdr, ack_seq ) );
+
+  if ( co->tcp.urg && !co->tcp.urg_ptr )
+    template_add_patch ( t, PATCH_RANDOM, 2, offset + offsetof ( struct tcphdr, urg_ptr ) );
+
+  if ( !co->tcp.window )
+    template_add_patch ( t, PATCH_RANDOM, 2, offset + offsetof ( struct tcphdr, window ) );
+
+  template_add_cksum ( t, co->bogus_csum ? CSUM_BOGUS : CSUM_INET,
+                       offset + offsetof ( struct tcphdr, check ),
+                       offset, sizeof ( struct tcphdr ) + sizeof ( struct psdhdr ) );
+
+  template_add_gre_cksum ( t, co );
+
+  return 1;
+}
+
 /* TCP options size calculation. */
 size_t tcp_options_len ( const uint8_t tcp_options, int useMD5, int useAuth )
 {
@@ -27,35 +27,40 @@
 #include <t50_memalloc.h>
 #include <t50_modules.h>
 #include <t50_randomizer.h>
+#include <t50_template.h>
 
-/**
- * UDP packet header configuration.
- *
- * Configures the UDP packet header.
- * A pointer to this function will be on modules table.
- *
- * @param co Pointer to T50 configuration structure.
- * @param size Pointer to packet size (updated by the function).
- */
-void udp ( const config_options_T * const restrict co, size_t * restrict size )
+/* What is the same on every packet (see udp_batch()). */
+typedef struct
+{
+  size_t greoptlen;     /* GRE options size. */
+  size_t size;          /* Packet size. */
+} udp_layout_T;
+
+static void udp_layout ( const config_options_T * const restrict co, udp_layout_T * restrict l )
 {
-  size_t length;
+  l->greoptlen = gre_opt_len ( co );
+  l->size = sizeof ( struct iphdr )  +
+            sizeof ( struct udphdr ) +
+            sizeof ( struct psdhdr ) +
+            l->greoptlen;
+}
+
+static void udp_build ( const config_options_T * const restrict co,
+                        const udp_layout_T * restrict l,
+                        packet_buffer_T * restrict pb,
+                        size_t * restrict size )
+{
+  void *packet;
 
   struct iphdr *ip;
   struct iphdr *gre_ip;
   struct udphdr *udp;
   struct psdhdr *pseudo;
 
-  assert ( co != NULL );
-
-  length = gre_opt_len ( co );
-  *size = sizeof ( struct iphdr )  +
-          sizeof ( struct udphdr ) +
-          sizeof ( struct psdhdr ) +
-          length;
+  *size = l->size;
 
-  /* Try to reallocate packet, if necessary */
-  alloc_packet ( *size );
+  /* Get room for the packet, if necessary */
+  packet = packet_reserve ( pb, *size );
 
   /* Fill IP header. */
   ip = ip_header ( packet, *size, co );
@@ -65,7 +70,7 @@ void udp ( const config_options_T * const restrict co, size_t * restrict size )
                                sizeof ( struct udphdr ) );
 
   /* UDP Header structure making a pointer to  IP Header structure. */
-  udp         = ( void * ) ( ip + 1 ) + length;
+  udp         = ( void * ) ( ip + 1 ) + l->greoptlen;
   udp->source = IPPORT_RND ( co->source );
   udp->dest   = IPPORT_RND ( co->dest );
   udp->len    = htons ( sizeof ( struct udphdr ) );
@@ -95,3 +100,95 @@ void udp ( const config_options_T * const restrict co, size_t * restrict size )
 
   gre_checksum ( packet, co, *size );
 }
+
+/**
+ * UDP packet header configuration.
+ *
+ * Configures the UDP packet header.
+ * A pointer to this function will be on modules table.
+ *
+ * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
+ * @param size Pointer to packet size (updated by the function).
+ */
+void udp ( const config_options_T * const restrict co, packet_buffer_T * restrict pb, size_t * restrict size )
+{
+  udp_layout_T l;
+
+  assert ( co != NULL );
+
+  udp_layout ( co, &l );
+  udp_build ( co, &l, pb, size );
+}
+
+/**
+ * Builds a batch of UDP packets.
+ *
+ * @param co Pointer to T50 configuration structure (addresses and ports
+ *           are changed).
+ * @param vars Addresses and ports of each packet.
+ * @param pbs Buffers where the packets are built.
+ * @param sizes Sizes of the packets (updated by the function).
+ * @param count Number of packets.
+ */
+void udp_batch ( config_options_T * const restrict co,
+                 const packet_vars_T * restrict vars,
+                 packet_buffer_T * restrict pbs,
+                 size_t * restrict sizes,
+                 unsigned int count )
+{
+  udp_layout_T l;
+  unsigned int i;
+
+  assert ( co != NULL );
+
+  udp_layout ( co, &l );
+
+  i = 0;
+  while ( i < count )
+  {
+    set_packet_vars ( co, &vars[i] );
+    udp_build ( co, &l, &pbs[i], &sizes[i] );
+    i++;
+  }
+}
+
+/**
+ * UDP packet template.
+ *
+ * Builds the packet once and marks the fields changed on every packet.
+ *
+ * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the image is built.
+ * @param t Pointer to the template.
+ * @return true (always supported).
+ */
+int udp_template ( const config_options_T * const restrict co,
+                  packet_buffer_T * restrict pb,
+                  template_T * restrict t )
+{
+  size_t size, offset;
+
+  udp ( co, pb, &size );
+  template_image ( t, pb->data, size );
+
+  offset = sizeof ( struct iphdr ) + gre_opt_len ( co );
+
+  template_add_ip ( t, co, offset + sizeof ( struct udphdr ) );
+
+  if ( !co->source || co->sports )
+    template_add_patch ( t, co->sports ? PATCH_SPORT : PATCH_RANDOM, 2,
+                         offset + offsetof ( struct udphdr, source ) );
+
+  if ( !co->dest || co->dports )
+    template_add_patch ( t, co->dports ? PATCH_DPORT : PATCH_RANDOM, 2,
+                         offset + offsetof ( struct udphdr, dest ) );
+
+  template_add_cksum ( t, co->bogus_csum ? CSUM_BOGUS : CSUM_INET,
+                       offset + offsetof ( struct udphdr, check ),
+                       offset, sizeof ( struct udphdr ) + sizeof ( struct psdhdr ) );
+
+  template_add_gre_cksum ( t, co );
+
+  return 1;
+}
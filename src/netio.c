@@ -19,7 +19,11 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+// Needed for sendmmsg().
+#define _GNU_SOURCE
+
 #include <stdbool.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
 #include <errno.h>
@@ -29,9 +33,17 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/net_tstamp.h>
 #include <t50_defines.h>
 #include <t50_errors.h>
+#include <t50_memalloc.h>
 #include <t50_netio.h>
+#include <t50_backends.h>
+#include <t50_pacing.h>
 #include <t50_randomizer.h>
 
 /* Maximum number of tries to send the packet. */
@@ -40,17 +52,51 @@
 /* Polling timeout is 1 second. */
 #define TIMEOUT 1000
 
+/* Wait before each retry, on "retry" backpressure (ms). */
+#define RETRY_TIMEOUT 1
+
+/* NOTE: Every worker has its own socket, batch and statistics. */
+
 /* Initialized for error condition, just in case! */
-static int fd = -1;
+static _Thread_local int fd = -1;
+
+/* Used for statistics.
+   Workers point this to their own counters. */
+static tx_stats_T main_stats;
+_Thread_local tx_stats_T *tx_stats = &main_stats;
+
+/* Backpressure strategy (--backpressure). */
+static _Thread_local int bp_mode = BACKPRESSURE_POLL;
+
+/* Batched transmission (sendmmsg).
+   Each message points to its own slot, iovec and destination address,
+   so the packets are built in place and sent with a single syscall. */
+static _Thread_local struct mmsghdr     *batch_msgs = NULL;
+static _Thread_local struct iovec       *batch_iovs = NULL;
+static _Thread_local struct sockaddr_in *batch_addrs = NULL;
+static _Thread_local packet_buffer_T    *batch_slots = NULL;   /* From the worker arena. */
+static _Thread_local unsigned int        batch_size = 1;    /* 1 means "no batching". */
+static _Thread_local unsigned int        batch_count = 0;   /* Packets waiting on the batch. */
+
+/* Departure time (SCM_TXTIME) control message. */
+typedef union
+{
+  struct cmsghdr hdr;
+  uint8_t        buffer[CMSG_SPACE ( sizeof ( uint64_t ) )];
+} txtime_cmsg_T;
 
-/* Used for statistics. */
-uint64_t bytes_sent = 0ULL;
-uint64_t packets_sent = 0ULL;
+static _Thread_local _Bool               use_txtime = 0;
+static _Thread_local txtime_cmsg_T      *batch_ctrls = NULL;
 
-//static int wait_for_io ( int );
 static void socket_setnonblocking( int );
 static void socket_setiphdrincl( int );
+static void socket_bindtodevice ( int, const char * const );
 static ssize_t socket_send ( int, struct sockaddr_in *, void *, size_t );
+static void alloc_batch ( unsigned int );
+static void destroy_batch ( void );
+static void socket_settxtime ( int, int );
+static void set_txtime ( struct msghdr *, txtime_cmsg_T * );
+static int  poll_io ( int, short, int );
 #ifdef SO_SNDBUF
   static void socket_setup_sendbuffer ( int );
 #endif
@@ -61,11 +107,100 @@ static ssize_t socket_send ( int, struct sockaddr_in *, void *, size_t );
   static void socket_setpriority( int );
 #endif
 
+/* Raw socket backend. */
+static void  raw_create ( const config_options_T * const restrict );
+static void  raw_close ( void );
+static void *raw_get_slot ( size_t * );
+static int   raw_send ( const void * const, size_t, const config_options_T * const restrict );
+static int   raw_flush ( void );
+
+/* Transmit backends table.
+   NOTE: Entries must follow the order of BACKEND_* identifiers. */
+BEGIN_BACKENDS_TABLE
+  BACKEND_ENTRY ( BACKEND_RAW,    "raw",    "Raw IP socket (sendto/sendmmsg)",     raw )
+  BACKEND_ENTRY ( BACKEND_PACKET, "packet", "AF_PACKET TPACKET_V3 TX_RING",        txring )
+  BACKEND_ENTRY ( BACKEND_XDP,    "xdp",    "AF_XDP socket (zero-copy or copy mode)", xdp )
+  BACKEND_ENTRY ( BACKEND_URING,  "uring",  "Raw IP socket, io_uring sendmsg",     uring )
+  /* --- add yours here */
+END_BACKENDS_TABLE
+
+/* Selected backend. */
+static _Thread_local backends_table_T *backend = backends_table;
+
+/**
+ * Creates and configure the sending socket, using the selected backend.
+ *
+ * @param co Pointer to configurations for T50.
+ */
+void create_socket ( const config_options_T * const restrict co )
+{
+  bp_mode = co->backpressure;
+  backend = &backends_table[co->backend];
+  backend->create ( co );
+}
+
+/**
+ * Tiny routine used to make sure the socket file descriptor is closed.
+ */
+void close_socket ( void )
+{
+  backend->close();
+}
+
+/**
+ * Gets the slot where the next packet should be built.
+ *
+ * @param size Pointer where the slot size will be stored.
+ * @return Pointer to the slot or NULL, if the packet must be built on the
+ *         default packet buffer.
+ */
+void *get_packet_slot ( size_t *size )
+{
+  return backend->get_slot ( size );
+}
+
+/**
+ * Send a packet through the wire.
+ *
+ * @param buffer Pointer to the packet buffer.
+ * @param size Size of the buffer.
+ * @param co Pointer to configurations for T50.
+ * @return true (success) or false (error).
+ */
+int send_packet ( const void * const buffer,
+                  size_t size,
+                  const config_options_T * const restrict co )
+{
+  assert ( buffer != NULL );
+  assert ( size > 0 );
+  assert ( co != NULL );
+
+  return backend->send ( buffer, size, co );
+}
+
+/**
+ * Sends all packets waiting to be transmitted (if any).
+ *
+ * @return true (success) or false (error).
+ */
+int flush_packets ( void )
+{
+  return backend->flush();
+}
+
 /**
  * Creates and configure a raw socket.
+ *
+ * Used by the raw and io_uring backends.
+ *
+ * @param co Pointer to configurations for T50.
+ * @param nonblocking Set the socket to non-blocking mode?
+ * @return The socket descriptor.
  */
-void create_socket ( void )
+int raw_socket ( const config_options_T * const restrict co, _Bool nonblocking )
 {
+  int fd;
+
   /* Setting SOCKET RAW.
      NOTE: Protocol must be IPPROTO_RAW on Linux.
            On FreeBSD, if we use 0 IPPROTO_RAW is assumed by default,
@@ -79,7 +214,9 @@ void create_socket ( void )
 #endif
   }
 
-  socket_setnonblocking( fd );  // FIXME: Possibly not necessary!
+  if ( nonblocking )
+    socket_setnonblocking( fd );  // FIXME: Possibly not necessary!
+
   socket_setiphdrincl( fd );
 
 #ifdef SO_SNDBUF
@@ -93,12 +230,26 @@ void create_socket ( void )
 #ifdef SO_PRIORITY
   socket_setpriority( fd );
 #endif
+
+  if ( co->iface )
+    socket_bindtodevice ( fd, co->iface );
+
+  return fd;
 }
 
-/**
- * Tiny routine used to make sure the socket file descriptor is closed.
- */
-void close_socket ( void )
+void raw_create ( const config_options_T * const restrict co )
+{
+  fd = raw_socket ( co, 1 );
+
+  /* NOTE: Must be set before the batch allocation. */
+  if ( ( use_txtime = co->txtime != TXTIME_NONE ) )
+    socket_settxtime ( fd, co->txtime );
+
+  if ( co->batch > 1 )
+    alloc_batch ( co->batch );
+}
+
+void raw_close ( void )
 {
   /* Close only if the descriptor is valid. */
   if ( fd > 0 )
@@ -108,19 +259,22 @@ void close_socket ( void )
     /* Added to avoid multiple socket closing. */
     fd = -1;
   }
+
+  destroy_batch();
 }
 
-/**
- * Send a packet through the wire.
- *
- * @param buffer Pointer to the packet buffer.
- * @param size Size of the buffer.
- * @param co Pointer to configurations for T50.
- * @return true (success) or false (error).
- */
-int send_packet ( const void * const buffer,
-                  size_t size,
-                  const config_options_T * const restrict co )
+void *raw_get_slot ( size_t *size )
+{
+  if ( batch_size <= 1 )
+    return NULL;
+
+  *size = TX_SLOT_SIZE;
+  return batch_slots[batch_count].data;
+}
+
+int raw_send ( const void * const buffer,
+               size_t size,
+               const config_options_T * const restrict co )
 {
   struct sockaddr_in sin =
   {
@@ -128,14 +282,37 @@ int send_packet ( const void * const buffer,
     .sin_port = htons ( IPPORT_RND ( co->dest ) ),
     .sin_addr.s_addr = co->ip.daddr    /* Already in network byte order! */
   };
+  ssize_t r;
 
-  assert ( buffer != NULL );
-  assert ( size > 0 );
-  assert ( co != NULL );
+  /* Queue the packet, sending the whole batch when it is full. */
+  if ( batch_size > 1 )
+  {
+    void *slot = batch_slots[batch_count].data;
+
+    /* Packet not built in place? Copy it! */
+    if ( buffer != slot )
+    {
+      if ( size > TX_SLOT_SIZE )
+        fatal_error ( "Packet (%zu bytes) is too big for the transmit slot.", size );
+
+      memcpy ( slot, buffer, size );
+    }
+
+    batch_iovs[batch_count].iov_len = size;
+    batch_addrs[batch_count] = sin;
+
+    if ( use_txtime )
+      set_txtime ( &batch_msgs[batch_count].msg_hdr, &batch_ctrls[batch_count] );
+
+    if ( ++batch_count < batch_size )
+      return 1;
+
+    return raw_flush();
+  }
 
   /* Use socket_send(), below. */
   errno = 0;
-  if ( socket_send ( fd, &sin, ( void * ) buffer, size ) == -1 )
+  if ( ( r = socket_send ( fd, &sin, ( void * ) buffer, size ) ) == -1 )
   {
     if ( errno == EPERM )
       fatal_error ( "Cannot send packet (Permission!?). Please check your firewall rules (iptables?)." );
@@ -143,11 +320,245 @@ int send_packet ( const void * const buffer,
     return 0;
   }
 
-  packets_sent++;
+  /* NOTE: 0 means the packet was dropped, but this isn't an error. */
+  if ( r )
+    tx_stats->packets_sent++;
 
   return 1;
 }
 
+/* Sends all packets waiting on the batch with sendmmsg().
+
+   Statistics are updated from each message results, since the kernel may
+   take only part of the batch. */
+int raw_flush ( void )
+{
+  struct mmsghdr *msg;
+  unsigned int n, tries;
+  int r;
+
+  tries = 0;
+  msg = batch_msgs;
+  n = batch_count;
+  batch_count = 0;
+
+  while ( n )
+  {
+    errno = 0;
+    if ( ( r = sendmmsg ( fd, msg, n, MSG_NOSIGNAL ) ) == -1 )
+    {
+      /* Same as socket_send(), below. */
+      switch ( errno )
+      {
+        case EINTR:
+          continue;
+
+        case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
+          if ( backpressure ( fd, &tries ) )
+            continue;
+
+          /* The rest of the batch is dropped. */
+          tx_stats->packets_dropped += n;
+          return 1;
+
+        case EPERM:
+          fatal_error ( "Cannot send packet (Permission!?). Please check your firewall rules (iptables?)." );
+      }
+
+      return 0;
+    }
+
+    n -= r;
+    while ( r-- )
+    {
+      tx_stats->packets_sent++;
+      tx_stats->bytes_sent += msg->msg_len;
+      msg++;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * Handles a full transmit queue, accordingly to the backpressure strategy.
+ *
+ * "poll" waits for the socket to be writable, "retry" retries the send up
+ * to MAX_SENDTO_RETRYS times (waiting RETRY_TIMEOUT before each one) and
+ * "drop" gives up at once. Dropped packets must be
+ * accounted by the caller.
+ *
+ * @param fd Socket descriptor.
+ * @param tries Pointer to the number of tries so far (start with 0).
+ * @return true if the send must be retried, false if the packet must be dropped.
+ */
+int backpressure ( int fd, unsigned int *tries )
+{
+  switch ( bp_mode )
+  {
+    case BACKPRESSURE_DROP:
+      return 0;
+
+    case BACKPRESSURE_RETRY:
+      if ( ++*tries > MAX_SENDTO_RETRYS )
+        return 0;
+
+      /* Give the queue some time to drain.
+         NOTE: The socket may be writable while the queue below it (qdisc
+               or device) is still full, so sleep the whole interval
+               instead of polling the socket. */
+      poll_io ( -1, 0, RETRY_TIMEOUT );
+      tx_stats->send_retries++;
+      return 1;
+  }
+
+  wait_for_io ( fd, POLLOUT );
+  tx_stats->send_retries++;
+  return 1;
+}
+
+/**
+ * Waits (at most TIMEOUT miliseconds) for an event on a descriptor,
+ * accounting the time spent blocked.
+ *
+ * @param fd Descriptor.
+ * @param events Events to wait for (as in poll()).
+ * @return Same as poll().
+ */
+int wait_for_io ( int fd, short events )
+{
+  return poll_io ( fd, events, TIMEOUT );
+}
+
+/* Same as wait_for_io(), with a given timeout (ms). */
+static int poll_io ( int fd, short events, int timeout )
+{
+  struct pollfd pfd = { .fd = fd, .events = events };
+  struct timespec t0, t1;
+  int r;
+
+  tx_stats->io_waits++;
+
+  clock_gettime ( CLOCK_MONOTONIC, &t0 );
+  if ( ( r = poll ( &pfd, 1, timeout ) ) == -1 && errno != EINTR )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Error waiting for the kernel: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Error waiting for the kernel" );
+#endif
+  }
+  clock_gettime ( CLOCK_MONOTONIC, &t1 );
+
+  tx_stats->blocked_time += ( t1.tv_sec - t0.tv_sec ) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+
+  return r;
+}
+
+/**
+ * Gets the index of a network interface.
+ *
+ * @param name Interface name.
+ * @return Interface index.
+ */
+int get_iface_index ( const char * const name )
+{
+  unsigned int idx;
+
+  if ( ! ( idx = if_nametoindex ( name ) ) )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot find interface %s: \"%s\"", name, strerror ( errno ) );
+#else
+    fatal_error ( "Cannot find interface %s", name );
+#endif
+  }
+
+  return idx;
+}
+
+/**
+ * Gets the hardware (MAC) address of a network interface.
+ *
+ * @param name Interface name.
+ * @param mac Pointer to a 6 bytes buffer where the address will be stored.
+ */
+void get_iface_hwaddr ( const char * const name, uint8_t *mac )
+{
+  struct ifreq ifr;
+  int s;
+
+  memset ( &ifr, 0, sizeof ifr );
+  strncpy ( ifr.ifr_name, name, IFNAMSIZ - 1 );
+
+  if ( ( s = socket ( AF_INET, SOCK_DGRAM, 0 ) ) == -1 ||
+       ioctl ( s, SIOCGIFHWADDR, &ifr ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot get %s hardware address: \"%s\"", name, strerror ( errno ) );
+#else
+    fatal_error ( "Cannot get %s hardware address", name );
+#endif
+  }
+
+  close ( s );
+  memcpy ( mac, ifr.ifr_hwaddr.sa_data, 6 );
+}
+
+/* Allocates the batch slots and the sendmmsg() structures. */
+static void alloc_batch ( unsigned int size )
+{
+  unsigned int i;
+
+  if ( ! ( batch_msgs = calloc ( size, sizeof ( struct mmsghdr ) ) ) ||
+       ! ( batch_iovs = calloc ( size, sizeof ( struct iovec ) ) ) ||
+       ! ( batch_addrs = calloc ( size, sizeof ( struct sockaddr_in ) ) ) ||
+       ! ( batch_slots = calloc ( size, sizeof ( packet_buffer_T ) ) ) )
+    fatal_error ( "Cannot allocate transmit batch." );
+
+  if ( use_txtime && ! ( batch_ctrls = calloc ( size, sizeof ( txtime_cmsg_T ) ) ) )
+    fatal_error ( "Cannot allocate transmit batch." );
+
+  /* Each message has its own slot. Only the lengths will change. */
+  i = 0;
+  while ( i < size )
+  {
+    packet_get ( &batch_slots[i], TX_SLOT_SIZE );
+
+    batch_iovs[i].iov_base = batch_slots[i].data;
+    batch_msgs[i].msg_hdr.msg_name = &batch_addrs[i];
+    batch_msgs[i].msg_hdr.msg_namelen = sizeof ( struct sockaddr_in );
+    batch_msgs[i].msg_hdr.msg_iov = &batch_iovs[i];
+    batch_msgs[i].msg_hdr.msg_iovlen = 1;
+    i++;
+  }
+
+  batch_size = size;
+  batch_count = 0;
+}
+
+static void destroy_batch ( void )
+{
+  unsigned int i;
+
+  /* Slots back to the arena. */
+  i = 0;
+  while ( batch_slots && i < batch_size )
+    packet_put ( &batch_slots[i++] );
+
+  SAFE_FREE ( batch_msgs );
+  SAFE_FREE ( batch_iovs );
+  SAFE_FREE ( batch_addrs );
+  SAFE_FREE ( batch_slots );
+  SAFE_FREE ( batch_ctrls );
+
+  batch_size = 1;
+  batch_count = 0;
+}
+
 #ifdef SO_SNDBUF
 /* Taken from libdnet by Dug Song. */
 void socket_setup_sendbuffer ( int fd )
@@ -190,29 +601,84 @@ void socket_setup_sendbuffer ( int fd )
 }
 #endif /* SO_SNDBUF */
 
-// FIXME: Maybe it is necessary to insert a counter, in case of multiple failures...
+/* Enables departure times on the socket (SO_TXTIME).
+   The clock must be the same used by the qdisc. */
+static void socket_settxtime ( int fd, int mode )
+{
+#ifdef SO_TXTIME
+  struct sock_txtime st = { .clockid = mode == TXTIME_ETF ? CLOCK_TAI : CLOCK_MONOTONIC };
+
+  if ( setsockopt ( fd, SOL_SOCKET, SO_TXTIME, &st, sizeof st ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot set SO_TXTIME: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot set SO_TXTIME" );
+#endif
+  }
+#else
+  fatal_error ( "SO_TXTIME isn't supported." );
+#endif
+}
+
+/* Attaches the departure time of the current packet to a message. */
+static void set_txtime ( struct msghdr *msg, txtime_cmsg_T *ctrl )
+{
+#ifdef SO_TXTIME
+  struct cmsghdr *cmsg;
+
+  msg->msg_control = ctrl;
+  msg->msg_controllen = sizeof ( txtime_cmsg_T );
+
+  cmsg = CMSG_FIRSTHDR ( msg );
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_TXTIME;
+  cmsg->cmsg_len = CMSG_LEN ( sizeof ( uint64_t ) );
+  memcpy ( CMSG_DATA ( cmsg ), &txtime, sizeof ( uint64_t ) );
+#endif
+}
+
+/* Returns the number of bytes sent, 0 if the packet was dropped (backpressure)
+   or -1 on error. */
 static ssize_t socket_send ( int fd, struct sockaddr_in *saddr, void *buffer, size_t size )
 {
+  struct iovec iov = { .iov_base = buffer, .iov_len = size };
+  struct msghdr msg = { .msg_name = saddr,
+                        .msg_namelen = sizeof ( struct sockaddr_in ),
+                        .msg_iov = &iov,
+                        .msg_iovlen = 1 };
+  txtime_cmsg_T ctrl;
   ssize_t r;
+  unsigned int tries;
 
-  /* sendto can set errno to EINTR if a signal interrupts the syscall or
-     EAGAIN (or EWOULDBLOCK) if there is no room in the send buffer. */
-retry:
-  errno = 0;
-  r = sendto ( fd, buffer, size, MSG_NOSIGNAL, ( struct sockaddr * ) saddr, sizeof ( struct sockaddr_in ) );
+  if ( use_txtime )
+    set_txtime ( &msg, &ctrl );
 
-  /* FIXME: Is this really necessary? */
-  switch ( errno )
+  /* sendmsg can set errno to EINTR if a signal interrupts the syscall or
+     EAGAIN (or EWOULDBLOCK) if there is no room in the send buffer. */
+  tries = 0;
+  while ( ( r = sendmsg ( fd, &msg, MSG_NOSIGNAL ) ) == -1 )
   {
-    case EINTR:
-    case EAGAIN:
+    switch ( errno )
+    {
+      case EINTR:
+        continue;
+
+      case EAGAIN:
 #if EWOULDBLOCK != EAGAIN
-    case EWOULDBLOCK:
+      case EWOULDBLOCK:
 #endif
-      goto retry;
+        if ( backpressure ( fd, &tries ) )
+          continue;
+
+        tx_stats->packets_dropped++;
+        return 0;
+    }
+
+    return -1;
   }
 
-  bytes_sent += size;
+  tx_stats->bytes_sent += size;
 
   return r;
 }
@@ -321,6 +787,19 @@ void socket_setiphdrincl( int fd )
   }
 }
 
+/* Sends the packets only through the given interface. */
+void socket_bindtodevice ( int fd, const char * const iface )
+{
+  if ( setsockopt ( fd, SOL_SOCKET, SO_BINDTODEVICE, iface, strlen ( iface ) + 1 ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot bind socket to interface %s: \"%s\"", iface, strerror ( errno ) );
+#else
+    fatal_error ( "Cannot bind socket to interface %s", iface );
+#endif
+  }
+}
+
 #ifdef SO_BROADCAST
 void socket_setbroadcast( int fd )
 {
@@ -0,0 +1,195 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file pacing.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Token bucket rate limiter (--pps and --bps).
+
+   Every worker has its own bucket, with its share of the rate. The credit
+   is kept in "nano units" (packets or bits times 10^9), so refilling it is
+   just the elapsed nanoseconds times the rate.
+
+   The clock is read only when the credit runs out and, then, we wait for
+   a whole quantum (--batch packets) of credit. Long waits sleep, but the
+   last microseconds are spent spinning, since the sleep isn't precise.
+
+   With --txtime, there is no bucket: Each packet is stamped with its
+   departure time and the qdisc (ETF or FQ) releases it. We only sleep to
+   avoid getting too far ahead of the schedule (the qdisc queue is finite). */
+
+#include <stdint.h>
+#include <time.h>
+#include <t50_defines.h>
+#include <t50_config.h>
+#include <t50_netio.h>
+#include <t50_pacing.h>
+
+#define NSEC_PER_SEC      1000000000ULL
+#define PACING_SPIN_NS    50000       /* Spin on the last 50 us of a wait. */
+#define PACING_BURST_NS   1000000     /* Credit is accumulated up to 1 ms. */
+#define TXTIME_DELAY_NS   500000      /* Departure of the first packet (500 us). */
+#define TXTIME_AHEAD_NS   2000000     /* How far ahead of the clock we can get (2 ms). */
+
+/* NOTE: Every worker has its own bucket. */
+static _Thread_local uint64_t  rate = 0;        /* Units per second (0 = unlimited). */
+static _Thread_local _Bool     rate_bits;       /* Units are bits (--bps)? */
+static _Thread_local uint64_t  quantum;         /* Packets per clock reading. */
+static _Thread_local uint64_t  credit;          /* In nano units. */
+static _Thread_local uint64_t  credit_max;
+static _Thread_local uint64_t  last;            /* Last refill (ns). */
+
+/* Departure times (--txtime). */
+static _Thread_local clockid_t txtime_clock = -1;  /* -1 = no departure times. */
+static _Thread_local uint64_t  next_txtime;
+static _Thread_local uint64_t  txtime_frac;     /* Remainder (nano units). */
+_Thread_local uint64_t         txtime;          /* Departure time of the current packet. */
+
+static inline uint64_t clock_ns ( clockid_t clk )
+{
+  struct timespec ts;
+
+  clock_gettime ( clk, &ts );
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline uint64_t now_ns ( void )
+{
+  return clock_ns ( CLOCK_MONOTONIC );
+}
+
+static inline void sleep_ns ( clockid_t clk, uint64_t t )
+{
+  struct timespec ts = { .tv_sec = t / NSEC_PER_SEC, .tv_nsec = t % NSEC_PER_SEC };
+
+  clock_nanosleep ( clk, 0, &ts, NULL );
+}
+
+static inline void cpu_relax ( void )
+{
+#if defined(__i386) || defined(__x86_64)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__ ( "yield" );
+#endif
+}
+
+/**
+ * Initializes the calling worker bucket.
+ *
+ * @param co Pointer to T50 configuration (with the worker share of the rate).
+ */
+void init_pacing ( const config_options_T * const restrict co )
+{
+  rate_bits = !co->pps;
+  rate = rate_bits ? co->bps : co->pps;
+  quantum = co->batch;
+  credit_max = rate * ( PACING_BURST_NS );
+  credit = 0;
+  last = now_ns();
+
+  txtime_clock = -1;
+  if ( co->txtime )
+  {
+    /* ETF works only with TAI. */
+    txtime_clock = co->txtime == TXTIME_ETF ? CLOCK_TAI : CLOCK_MONOTONIC;
+    next_txtime = clock_ns ( txtime_clock ) + TXTIME_DELAY_NS;
+    txtime_frac = 0;
+  }
+}
+
+/* Stamps the packet with its departure time (--txtime). */
+static void pace_txtime ( uint64_t cost )
+{
+  uint64_t t;
+
+  t = clock_ns ( txtime_clock );
+
+  /* Fell behind the schedule? Start over, or the qdisc will drop
+     the packets. */
+  if ( next_txtime < t )
+    next_txtime = t + TXTIME_DELAY_NS;
+  else if ( next_txtime - t > TXTIME_AHEAD_NS )
+    sleep_ns ( txtime_clock, next_txtime - t - TXTIME_AHEAD_NS );
+
+  txtime = next_txtime;
+
+  /* NOTE: The remainder is kept, so there is no drift. */
+  txtime_frac += cost;
+  next_txtime += txtime_frac / rate;
+  txtime_frac %= rate;
+}
+
+/* Adds the credit earned since the last refill, up to 'cap'. */
+static void refill ( uint64_t cap )
+{
+  uint64_t t, elapsed;
+
+  t = now_ns();
+  elapsed = t - last;
+  last = t;
+
+  /* NOTE: Avoids overflows after long idle times. */
+  if ( elapsed >= cap / rate )
+    credit = cap;
+  else if ( ( credit += elapsed * rate ) > cap )
+    credit = cap;
+}
+
+/**
+ * Waits until there is credit to send a packet.
+ *
+ * @param size Size of the packet (used only with --bps).
+ */
+void pace ( size_t size )
+{
+  uint64_t cost, need, cap, t;
+
+  if ( !rate )
+    return;
+
+  cost = ( rate_bits ? size * 8 : 1 ) * NSEC_PER_SEC;
+
+  if ( txtime_clock >= 0 )
+  {
+    pace_txtime ( cost );
+    return;
+  }
+
+  if ( credit < cost )
+  {
+    /* Wait for the whole quantum, at once. */
+    need = cost * quantum;
+    cap = need > credit_max ? need : credit_max;
+
+    refill ( cap );
+
+    while ( credit < need )
+    {
+      /* Sleep most of the time, spin the rest. */
+      if ( ( t = ( need - credit ) / rate ) > PACING_SPIN_NS )
+        sleep_ns ( CLOCK_MONOTONIC, t - PACING_SPIN_NS );
+      else
+        cpu_relax();
+
+      refill ( cap );
+    }
+  }
+
+  credit -= cost;
+}
@@ -0,0 +1,170 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file pipeline.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Pipeline rings (--pipeline).
+
+   Builder threads build the packets straight into the slots of their ring
+   and the worker (the sender) sends them from there, so heavy modules
+   don't keep the socket idle. Every builder has its own ring: With a
+   single producer and a single consumer, the indexes are only written by
+   their owners and an acquire/release pair is all the synchronization
+   needed.
+
+   The indexes are free running (the ring depth is a power of two). */
+
+#include <stdlib.h>
+#include <sched.h>
+#include <string.h>
+#include <t50_defines.h>
+#include <t50_errors.h>
+#include <t50_pipeline.h>
+
+/**
+ * Allocates a ring.
+ *
+ * @param depth Number of slots (power of two).
+ * @param slot_size Room for the packet, on each slot.
+ * @return Pointer to the ring.
+ */
+ring_T *ring_create ( uint32_t depth, uint32_t slot_size )
+{
+  ring_T *r = NULL;
+
+  if ( posix_memalign ( ( void ** ) &r, CACHE_LINE_SIZE, sizeof *r ) )
+    fatal_error ( "Cannot allocate pipeline ring." );
+
+  memset ( r, 0, sizeof *r );
+  r->mask = depth - 1;
+  r->slot_size = slot_size;
+
+  /* Slots don't share cache lines. */
+  r->stride = ( sizeof ( ring_slot_T ) + slot_size + CACHE_LINE_SIZE - 1 ) &
+              ~( size_t ) ( CACHE_LINE_SIZE - 1 );
+
+  if ( posix_memalign ( ( void ** ) &r->slots, CACHE_LINE_SIZE, depth * r->stride ) )
+    fatal_error ( "Cannot allocate pipeline ring (%u slots of %u bytes).", depth, slot_size );
+
+  return r;
+}
+
+/**
+ * Gets the number of free slots (builder).
+ *
+ * @return Number of slots or 0, if the ring is full.
+ */
+uint32_t ring_reserve ( ring_T *r )
+{
+  if ( r->head - r->tail_cache > r->mask )
+  {
+    r->tail_cache = __atomic_load_n ( &r->tail, __ATOMIC_ACQUIRE );
+
+    if ( r->head - r->tail_cache > r->mask )
+      return 0;
+  }
+
+  return r->mask + 1 - ( r->head - r->tail_cache );
+}
+
+/* Gets the number of free slots, waiting for the sender if the ring is full. */
+uint32_t ring_wait ( ring_T *r )
+{
+  uint32_t n;
+
+  if ( ! ( n = ring_reserve ( r ) ) )
+  {
+    /* Single writer (builder), but read by ring_statistics(). */
+    __atomic_store_n ( &r->full, r->full + 1, __ATOMIC_RELAXED );
+
+    do
+      sched_yield();
+    while ( ! ( n = ring_reserve ( r ) ) );
+  }
+
+  return n;
+}
+
+/* Gets the i-th free slot (builder). */
+ring_slot_T *ring_free_slot ( const ring_T *r, uint32_t i )
+{
+  return ( ring_slot_T * ) ( r->slots + ( ( r->head + i ) & r->mask ) * r->stride );
+}
+
+/* Makes n built slots visible to the sender. */
+void ring_commit ( ring_T *r, uint32_t n )
+{
+  __atomic_store_n ( &r->head, r->head + n, __ATOMIC_RELEASE );
+}
+
+/* No more packets will be committed. */
+void ring_close ( ring_T *r )
+{
+  __atomic_store_n ( &r->closed, 1, __ATOMIC_RELEASE );
+}
+
+/**
+ * Gets the number of packets waiting (sender).
+ *
+ * Every poll is accounted, so the average occupancy shows which side of
+ * the ring is the slower one.
+ */
+uint32_t ring_poll ( ring_T *r )
+{
+  uint32_t n;
+
+  r->head_cache = __atomic_load_n ( &r->head, __ATOMIC_ACQUIRE );
+  n = r->head_cache - r->tail;
+
+  /* Single writer (sender), but read by ring_statistics(). */
+  __atomic_store_n ( &r->occupancy, r->occupancy + n, __ATOMIC_RELAXED );
+  __atomic_store_n ( &r->polls, r->polls + 1, __ATOMIC_RELAXED );
+  if ( ! n )
+    __atomic_store_n ( &r->empty, r->empty + 1, __ATOMIC_RELAXED );
+
+  return n;
+}
+
+/* Gets the i-th packet waiting (sender). */
+ring_slot_T *ring_slot ( const ring_T *r, uint32_t i )
+{
+  return ( ring_slot_T * ) ( r->slots + ( ( r->tail + i ) & r->mask ) * r->stride );
+}
+
+/* Gives n slots back to the builder (sender). */
+void ring_release ( ring_T *r, uint32_t n )
+{
+  __atomic_store_n ( &r->tail, r->tail + n, __ATOMIC_RELEASE );
+}
+
+/* NOTE: Poll again after this: Packets may be committed before closing. */
+_Bool ring_closed ( const ring_T *r )
+{
+  return __atomic_load_n ( &r->closed, __ATOMIC_ACQUIRE );
+}
+
+/* Adds the ring statistics to 'stats' (may be called while it is used). */
+void ring_statistics ( const ring_T *r, pipeline_stats_T *stats )
+{
+  stats->full += __atomic_load_n ( &r->full, __ATOMIC_RELAXED );
+  stats->empty += __atomic_load_n ( &r->empty, __ATOMIC_RELAXED );
+  stats->occupancy += __atomic_load_n ( &r->occupancy, __ATOMIC_RELAXED );
+  stats->polls += __atomic_load_n ( &r->polls, __ATOMIC_RELAXED );
+  stats->depth = r->mask + 1;
+}
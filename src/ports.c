@@ -0,0 +1,251 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file ports.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Ports lists (--sport and --dport).
+
+   A list is "n[-m][,...]", expanded once, in the given order (a port given
+   twice is used twice as often). Every worker copies its sequence of
+   ports into its own table (on its NUMA node), as the mode says:
+
+     seq      Its slice of the list (split as the packets are), in order.
+     rr       The whole list, in order, starting at its share of it.
+     random   The whole list, picked at random.
+     permute  Its slice of the list, shuffled.
+
+   So getting the next port is just an index increment (or a random index). */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <t50_defines.h>
+#include <t50_config.h>
+#include <t50_errors.h>
+#include <t50_randomizer.h>
+#include <t50_ports.h>
+
+#define PORTS_MAXIMUM ( 1U << 20 )    /* Entries of an expanded list. */
+
+/* A list, as given (ports in network order). */
+typedef struct
+{
+  uint16_t *ports;
+  uint32_t count;
+} port_list_T;
+
+/* The sequence of a worker. */
+typedef struct
+{
+  uint16_t *table;
+  uint32_t size;
+  uint32_t next;
+  _Bool    random;
+} port_seq_T;
+
+static port_list_T sport_list, dport_list;
+static _Thread_local port_seq_T sport_seq, dport_seq;
+
+static void invalid_ports ( const char *optname, const char *arg )
+{
+  fatal_error ( "Invalid ports list '%s' for option '%s' (n[-m][,...] expected, "
+                "with ports between 1 and 65535).", arg, optname );
+}
+
+/* Expands the list into 'ports' (if not NULL), returning its size. */
+static uint32_t parse_ports ( const char *optname, const char *arg, uint16_t *ports )
+{
+  unsigned long first, last;
+  const char *p;
+  char *end;
+  uint32_t n;
+
+  n = 0;
+  p = arg;
+  while ( 1 )
+  {
+    if ( *p < '0' || *p > '9' )
+      invalid_ports ( optname, arg );
+
+    errno = 0;
+    first = last = strtoul ( p, &end, 10 );
+    p = end;
+
+    if ( *p == '-' )
+    {
+      p++;
+      if ( *p < '0' || *p > '9' )
+        invalid_ports ( optname, arg );
+
+      last = strtoul ( p, &end, 10 );
+      p = end;
+    }
+
+    if ( errno || first < 1 || last > 65535 || first > last )
+      invalid_ports ( optname, arg );
+
+    if ( last - first + 1 > PORTS_MAXIMUM - n )
+      fatal_error ( "Too many ports for option '%s' (maximum is %u).", optname, PORTS_MAXIMUM );
+
+    while ( first <= last )
+    {
+      if ( ports )
+        ports[n] = htons ( first );
+
+      n++;
+      first++;
+    }
+
+    if ( ! *p )
+      return n;
+
+    if ( *p++ != ',' )
+      invalid_ports ( optname, arg );
+  }
+}
+
+static void load_list ( port_list_T *list, const char *optname, const char *arg )
+{
+  list->count = parse_ports ( optname, arg, NULL );
+
+  if ( ! ( list->ports = malloc ( list->count * sizeof *list->ports ) ) )
+    fatal_error ( "Cannot allocate memory for %u ports.", list->count );
+
+  parse_ports ( optname, arg, list->ports );
+}
+
+/* Expands the ports lists (by the main thread). */
+void load_ports ( const config_options_T * const co )
+{
+  if ( co->sports )
+    load_list ( &sport_list, "--sport", co->sports );
+
+  if ( co->dports )
+    load_list ( &dport_list, "--dport", co->dports );
+}
+
+static void init_seq ( port_seq_T *seq, const port_list_T *list, int mode,
+                       unsigned int worker, unsigned int num_workers )
+{
+  uint32_t start, n, r, i, j;
+  uint16_t tmp;
+
+  n = list->count / num_workers;
+  r = list->count % num_workers;
+
+  switch ( mode )
+  {
+    case PORTS_SEQ:
+    case PORTS_PERMUTE:
+      start = worker * n + ( worker < r ? worker : r );
+      seq->size = n + ( worker < r );
+
+      /* More workers than ports? Use all of them. */
+      if ( ! seq->size )
+      {
+        start = 0;
+        seq->size = list->count;
+      }
+      break;
+
+    case PORTS_RR:
+      start = ( ( uint64_t ) worker * list->count ) / num_workers;
+      seq->size = list->count;
+      break;
+
+    default:
+      start = 0;
+      seq->size = list->count;
+  }
+
+  if ( ! ( seq->table = malloc ( seq->size * sizeof *seq->table ) ) )
+    fatal_error ( "Cannot allocate memory for %u ports.", seq->size );
+
+  /* The rotated list (only 'rr' starts in the middle). */
+  i = 0;
+  j = start;
+  while ( i < seq->size )
+  {
+    seq->table[i++] = list->ports[j++];
+
+    if ( j == list->count )
+      j = 0;
+  }
+
+  /* Fisher-Yates shuffle (repeatable with --seed). */
+  if ( mode == PORTS_PERMUTE )
+  {
+    i = seq->size;
+    while ( i > 1 )
+    {
+      j = ( ( uint64_t ) RANDOM() * i ) >> 32;
+      i--;
+
+      tmp = seq->table[i];
+      seq->table[i] = seq->table[j];
+      seq->table[j] = tmp;
+    }
+  }
+
+  seq->random = mode == PORTS_RANDOM;
+  seq->next = 0;
+}
+
+/* Builds the worker sequences (after SRANDOM()). */
+void init_ports ( const config_options_T * const co, unsigned int worker, unsigned int num_workers )
+{
+  if ( co->sports )
+    init_seq ( &sport_seq, &sport_list, co->sport_mode, worker, num_workers );
+
+  if ( co->dports )
+    init_seq ( &dport_seq, &dport_list, co->dport_mode, worker, num_workers );
+}
+
+/* Frees the worker sequences. */
+void destroy_ports ( void )
+{
+  SAFE_FREE ( sport_seq.table );
+  SAFE_FREE ( dport_seq.table );
+}
+
+static inline uint16_t next_port ( port_seq_T *seq )
+{
+  uint16_t port;
+
+  if ( seq->random )
+    return seq->table[ ( ( uint64_t ) RANDOM() * seq->size ) >> 32 ];
+
+  port = seq->table[seq->next];
+  if ( ++seq->next == seq->size )
+    seq->next = 0;
+
+  return port;
+}
+
+/* Next source port (in network order). */
+uint16_t next_sport ( void )
+{
+  return next_port ( &sport_seq );
+}
+
+/* Next destination port (in network order). */
+uint16_t next_dport ( void )
+{
+  return next_port ( &dport_seq );
+}
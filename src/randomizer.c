@@ -22,29 +22,34 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <string.h>
 #include <arpa/inet.h>
 #include <t50_defines.h>
 #include <t50_errors.h>
 #include <t50_randomizer.h>
 
-/* The Random SEED will be created by SRANDOM */
-static uint64_t _seed[2];
+/* Block generator.
 
-/* xorshift128+
+   RANDOM() takes the next word from the pool of the calling worker. When it
+   is empty, random_refill() fills it up again, all at once: xorshift128+
+   runs on RNG_LANES independent lanes (the loop over the lanes is
+   vectorized by the compiler), each step giving 64 bits (two words) per
+   lane. */
+#define RNG_LANES 8
 
-   We don't have to worry about the lower bits
-   been less random than the upper, in theory. */
-static uint32_t random_xorshift128plus ( void )
+_Thread_local rng_pool_T rng_pool;
+_Thread_local unsigned int rng_next = RNG_POOL_WORDS;
+
+/* The lanes are seeded by SRANDOM (one per worker). */
+static _Thread_local struct
 {
-  uint64_t s0 = _seed[1];
-  uint64_t s1 = _seed[0];
-  _seed[0] = s0;
+  uint64_t s0[RNG_LANES];
+  uint64_t s1[RNG_LANES];
+} lanes __attribute__ ( ( aligned ( 64 ) ) );
+static _Thread_local _Bool seeded = 0;
 
-  s1 ^= s1 << 23;
-  _seed[1] = s1 ^ s0 ^ ( s1 >> 18 ) ^ ( s0 >> 5 );
-
-  return ( _seed[1] + s0 );
-}
+static int rng = RNG_XORSHIFT;
+static _Bool has_rdrand = 0;
 
 // NOTE: Intel specific!
 #if defined(__i386) || defined(__x86_64)
@@ -62,22 +67,18 @@ static uint32_t random_rdrand ( void )
 }
 #endif
 
-static void empty_srandom ( void ) {}
-
-static void get_random_seed ( void )
+static void get_random_seed ( void *p, size_t size )
 {
   // NOTE: Could use gettimeofday() and use it as seed,
   //       but, this way I'll make sure the seed is random.
 
   int _fd, r;
-  void *p, *endp;
+  void *endp;
 
   if ( ( _fd = open ( "/dev/urandom", O_RDONLY ) ) == -1 )
     fatal_error ( "Cannot open /dev/urandom to get initial random seed." );
 
-  /* NOTE: initializes this code "global" _seed var. */
-  p = &_seed;
-  endp = p + sizeof _seed;
+  endp = p + size;
 
   while ( p < endp )
   {
@@ -93,10 +94,241 @@ static void get_random_seed ( void )
     fatal_error ( "Cannot read initial seed from /dev/urandom." );
 }
 
-/* The "constructor" below will overide this IF the platform is Intel/AMD and
-   if RDRAND is supported. */
-void ( *SRANDOM ) ( void ) = get_random_seed;
-uint32_t ( *RANDOM ) ( void ) = random_xorshift128plus;
+/**
+ * Gets a random seed (from RDRAND, if available, or /dev/urandom).
+ *
+ * Used when --seed isn't given. It is shown on the launch banner, so the
+ * run can be repeated.
+ */
+uint64_t random_seed ( void )
+{
+  uint64_t seed;
+
+#if defined(__i386) || defined(__x86_64)
+  if ( has_rdrand )
+    seed = ( uint64_t ) random_rdrand() << 32 | random_rdrand();
+  else
+#endif
+    get_random_seed ( &seed, sizeof seed );
+
+  return seed;
+}
+
+/* splitmix64: Expands the 64 bits seed to xorshift128+ state. */
+static uint64_t splitmix64 ( uint64_t *x )
+{
+  uint64_t z;
+
+  z = ( *x += 0x9e3779b97f4a7c15ULL );
+  z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+
+  return z ^ ( z >> 31 );
+}
+
+/* xorshift128+ jump function: Advances the state 2^64 steps. */
+static void jump_xorshift128plus ( uint64_t s[2] )
+{
+  static const uint64_t jump[] = { 0x8a5cd789635d2dffULL, 0x121fd2155c472f96ULL };
+  uint64_t j0, j1, t0, t1;
+  int i, b;
+
+  j0 = j1 = 0;
+
+  i = 0;
+  while ( i < 2 )
+  {
+    b = 0;
+    while ( b < 64 )
+    {
+      if ( jump[i] & ( 1ULL << b ) )
+      {
+        j0 ^= s[0];
+        j1 ^= s[1];
+      }
+
+      /* One step. */
+      t1 = s[0];
+      t0 = s[1];
+      s[0] = t0;
+      t1 ^= t1 << 23;
+      s[1] = t1 ^ t0 ^ ( t1 >> 18 ) ^ ( t0 >> 5 );
+
+      b++;
+    }
+
+    i++;
+  }
+
+  s[0] = j0;
+  s[1] = j1;
+}
+
+/**
+ * Seeds xorshift128+ lanes of the calling worker.
+ *
+ * The seed is expanded with splitmix64. Every lane of every worker gets its
+ * own stream, 2^64 numbers apart (jump function), so they never overlap:
+ * Lane l of worker w starts (w * RNG_LANES + l) jumps ahead.
+ *
+ * @param seed Seed (--seed or random_seed()).
+ * @param stream Worker index.
+ */
+void SRANDOM ( uint64_t seed, unsigned int stream )
+{
+  uint64_t s[2];
+  unsigned int n;
+  int i;
+
+  s[0] = splitmix64 ( &seed );
+  s[1] = splitmix64 ( &seed );
+
+  /* xorshift128+ state cannot be all zeros. */
+  if ( ! ( s[0] | s[1] ) )
+    s[0] = 1;
+
+  n = stream * RNG_LANES;
+  while ( n-- )
+    jump_xorshift128plus ( s );
+
+  i = 0;
+  while ( i < RNG_LANES )
+  {
+    lanes.s0[i] = s[0];
+    lanes.s1[i] = s[1];
+    jump_xorshift128plus ( s );
+    i++;
+  }
+
+  seeded = 1;
+  rng_next = RNG_POOL_WORDS;    /* Discard the old pool. */
+}
+
+/* xorshift128+ on all lanes, until the pool is full.
+
+   We don't have to worry about the lower bits
+   been less random than the upper, in theory. */
+static void fill_xorshift128plus ( void )
+{
+  uint64_t s0[RNG_LANES], s1[RNG_LANES], x, y;
+  uint64_t *q, *endq;
+  int i;
+
+  /* NOTE: Local copies, so the compiler keeps them on registers. */
+  memcpy ( s0, lanes.s0, sizeof s0 );
+  memcpy ( s1, lanes.s1, sizeof s1 );
+
+  q = rng_pool.q;
+  endq = q + RNG_POOL_WORDS / 2;
+  while ( q < endq )
+  {
+    i = 0;
+    while ( i < RNG_LANES )
+    {
+      x = s0[i];
+      y = s1[i];
+      s0[i] = y;
+
+      x ^= x << 23;
+      s1[i] = x ^ y ^ ( x >> 18 ) ^ ( y >> 5 );
+      q[i] = s1[i] + y;
+
+      i++;
+    }
+
+    q += RNG_LANES;
+  }
+
+  memcpy ( lanes.s0, s0, sizeof s0 );
+  memcpy ( lanes.s1, s1, sizeof s1 );
+}
+
+#if defined(__i386) || defined(__x86_64)
+static void fill_rdrand ( void )
+{
+  uint32_t *p, *endp;
+
+  p = rng_pool.d;
+  endp = p + RNG_POOL_WORDS;
+  while ( p < endp )
+    *p++ = random_rdrand();
+}
+#endif
+
+/**
+ * Fills the pool of random words of the calling worker.
+ *
+ * Called by RANDOM() when the pool is empty.
+ *
+ * @return The first word of the pool.
+ */
+uint32_t random_refill ( void )
+{
+  /* Workers call SRANDOM() on start. Others may not have called it. */
+  if ( ! seeded )
+    SRANDOM ( random_seed(), 0 );
+
+#if defined(__i386) || defined(__x86_64)
+  if ( rng == RNG_RDRAND )
+    fill_rdrand();
+  else
+#endif
+    fill_xorshift128plus();
+
+  rng_next = 1;
+  return rng_pool.d[0];
+}
+
+/**
+ * Fills a buffer with random bytes (fake payloads, authentication data...).
+ *
+ * The bytes are copied from the pool, instead of taking 8 bits of each
+ * RANDOM() call.
+ *
+ * @param ptr Pointer to the buffer.
+ * @param length Number of bytes.
+ */
+void random_fill ( void *ptr, size_t length )
+{
+  size_t n;
+
+  while ( length )
+  {
+    if ( rng_next >= RNG_POOL_WORDS )
+    {
+      random_refill();
+      rng_next = 0;
+    }
+
+    n = ( RNG_POOL_WORDS - rng_next ) * sizeof ( uint32_t );
+    if ( n > length )
+      n = length;
+
+    memcpy ( ptr, rng_pool.d + rng_next, n );
+
+    /* NOTE: Partially used words are discarded. */
+    rng_next += ( n + sizeof ( uint32_t ) - 1 ) / sizeof ( uint32_t );
+    ptr += n;
+    length -= n;
+  }
+}
+
+/**
+ * Selects the random number generator (--rng).
+ *
+ * @param r RNG_* identifier.
+ */
+void select_rng ( int r )
+{
+  rng = r;
+  rng_next = RNG_POOL_WORDS;
+}
+
+/* RDRAND instruction is available? */
+_Bool rdrand_supported ( void )
+{
+  return has_rdrand;
+}
 
 /**
  * Returns the Randomized netmask if foo is 0 or the parameter, otherwise.
@@ -130,7 +362,7 @@ uint32_t NETMASK_RND ( uint32_t foo )
 #if defined(__i386) || defined(__x86_64)
 #define RDRAND_BIT (1U << 30)
 
-//--- Make sure to use RDRAND instruction if the processor has it.
+//--- Check if the processor has RDRAND instruction (used to seed xorshift128+).
 static void _INIT check_rdrand ( void )
 {
   int c;
@@ -143,11 +375,7 @@ static void _INIT check_rdrand ( void )
 #endif
                        );
 
-  if ( c & RDRAND_BIT )
-  {
-    RANDOM = random_rdrand;
-    SRANDOM = empty_srandom;  // RDRAND doesn't need a seed.
-  }
+  has_rdrand = !! ( c & RDRAND_BIT );
 }
 #endif
 
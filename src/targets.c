@@ -0,0 +1,415 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file targets.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Target lists (--targets and --sources).
+
+   The file has one target per line: "a.b.c.d[/cidr] [weight]" ('#' starts
+   a comment). A CIDR has the same hosts as the command line target; the
+   weight of a target is, by default, its number of hosts (every address
+   has the same chance). Overlapping targets without explicit weights are
+   merged, so an address isn't chosen twice as often for being on two of
+   them.
+
+   The targets are sorted by address into a table of ranges (first address
+   and number of hosts) and a Walker/Vose alias table is built from their
+   weights. Choosing a destination takes 3 random numbers and 2 lookups,
+   whatever the size of the list: A bucket, its alias (if the first one
+   fails the bucket probability) and an offset inside the range.
+
+   Source pools (--sources) have the same format and are chosen the same
+   way. The tables are built by the main thread and are read only
+   afterwards (shared by all workers). */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <t50_config.h>
+#include <t50_defines.h>
+#include <t50_errors.h>
+#include <t50_cidr.h>
+#include <t50_randomizer.h>
+#include <t50_targets.h>
+
+#define TARGETS_LINE_SIZE 256
+
+/* A line of the file. */
+typedef struct
+{
+  uint32_t first;
+  uint32_t last;      /* Inclusive. */
+  uint64_t weight;    /* 0 = number of hosts. */
+} target_T;
+
+/* The tables are kept apart: A bucket and a range are 8 bytes each. */
+typedef struct
+{
+  uint32_t first;     /* Host order. */
+  uint32_t hosts;
+} range_T;
+
+typedef struct
+{
+  uint32_t prob;      /* Chance of the bucket itself (2^32 scale). */
+  uint32_t alias;
+} bucket_T;
+
+typedef struct
+{
+  range_T  *ranges;
+  bucket_T *buckets;
+  uint32_t num_ranges;
+} target_list_T;
+
+static target_list_T targets, sources;
+
+/* Parses "a.b.c.d[/cidr]", returning the first and last hosts (as
+   config_cidr() does) and a pointer to the next character, or NULL. */
+static const char *parse_target ( const char *p, target_T *t )
+{
+  uint32_t addr, octet, bits;
+  int i;
+
+  addr = 0;
+  i = 0;
+  while ( i < 4 )
+  {
+    if ( i && *p++ != '.' )
+      return NULL;
+
+    if ( *p < '0' || *p > '9' )
+      return NULL;
+
+    octet = 0;
+    while ( *p >= '0' && *p <= '9' && octet <= 255 )
+      octet = octet * 10 + *p++ - '0';
+
+    if ( octet > 255 )
+      return NULL;
+
+    addr = addr << 8 | octet;
+    i++;
+  }
+
+  bits = CIDR_MAXIMUM;
+  if ( *p == '/' )
+  {
+    p++;
+    if ( *p < '0' || *p > '9' )
+      return NULL;
+
+    bits = 0;
+    while ( *p >= '0' && *p <= '9' && bits <= CIDR_MAXIMUM )
+      bits = bits * 10 + *p++ - '0';
+
+    if ( bits < CIDR_MINIMUM || bits > CIDR_MAXIMUM )
+      return NULL;
+  }
+
+  if ( bits < CIDR_MAXIMUM )
+  {
+    t->first = ( addr & ~( ~0U >> bits ) ) + 1;
+    t->last = t->first + ( ( 1U << ( 32 - bits ) ) - 2U );
+  }
+  else
+    t->first = t->last = addr;
+
+  return p;
+}
+
+static int compare_targets ( const void *a, const void *b )
+{
+  const target_T *x = a, *y = b;
+
+  if ( x->first != y->first )
+    return x->first < y->first ? -1 : 1;
+
+  /* Larger ranges first, so the smaller ones are merged into them. */
+  if ( x->last != y->last )
+    return x->last > y->last ? -1 : 1;
+
+  return 0;
+}
+
+/* Reads the file into 'targets', returning how many there are. */
+static uint32_t read_targets ( const char *filename, target_T **targets )
+{
+  static char line[TARGETS_LINE_SIZE];
+  target_T *t, *tmp;
+  uint32_t n, size, lineno;
+  unsigned long long weight;
+  const char *p;
+  char *end;
+  FILE *f;
+
+  if ( ! ( f = fopen ( filename, "r" ) ) )
+    fatal_error ( "Cannot open targets file '%s': %s", filename, strerror ( errno ) );
+
+  t = NULL;
+  n = size = lineno = 0;
+
+  while ( fgets ( line, sizeof line, f ) )
+  {
+    lineno++;
+
+    if ( ! strchr ( line, '\n' ) && ! feof ( f ) )
+      fatal_error ( "%s:%u: Line too long.", filename, lineno );
+
+    p = line;
+    while ( *p == ' ' || *p == '\t' )
+      p++;
+
+    /* Empty lines and comments. */
+    if ( *p == '\n' || *p == '\r' || *p == '#' || ! *p )
+      continue;
+
+    if ( n == size )
+    {
+      size = size ? size * 2 : 1024;
+
+      if ( ! ( tmp = realloc ( t, size * sizeof *t ) ) )
+        fatal_error ( "Cannot allocate memory for %u targets.", size );
+
+      t = tmp;
+    }
+
+    if ( ! ( p = parse_target ( p, t + n ) ) )
+      fatal_error ( "%s:%u: Invalid target (a.b.c.d[/cidr] expected, with cidr between %u and %u).",
+                    filename, lineno, CIDR_MINIMUM, CIDR_MAXIMUM );
+
+    t[n].weight = 0;
+
+    if ( *p == ' ' || *p == '\t' )
+    {
+      while ( *p == ' ' || *p == '\t' )
+        p++;
+
+      if ( *p >= '0' && *p <= '9' )
+      {
+        errno = 0;
+        weight = strtoull ( p, &end, 10 );
+
+        if ( errno || ! weight )
+          fatal_error ( "%s:%u: Weight must be greater than 0 (and less than 2^64).", filename, lineno );
+
+        t[n].weight = weight;
+        p = end;
+      }
+
+      while ( *p == ' ' || *p == '\t' )
+        p++;
+    }
+
+    if ( *p != '\n' && *p != '\r' && *p != '#' && *p )
+      fatal_error ( "%s:%u: Invalid target.", filename, lineno );
+
+    n++;
+  }
+
+  if ( ferror ( f ) )
+    fatal_error ( "Cannot read targets file '%s'.", filename );
+
+  fclose ( f );
+
+  if ( ! n )
+    fatal_error ( "No targets on '%s'.", filename );
+
+  *targets = t;
+  return n;
+}
+
+/* Sorts the targets and merges the overlapping ones without weights.
+   Returns the new number of targets. */
+static uint32_t merge_targets ( target_T *t, uint32_t n )
+{
+  uint32_t i, j, last;    /* last: Last target without weight kept. */
+
+  qsort ( t, n, sizeof *t, compare_targets );
+
+  last = UINT32_MAX;
+  i = j = 0;
+  while ( i < n )
+  {
+    if ( ! t[i].weight && last != UINT32_MAX && t[i].first <= t[last].last )
+    {
+      if ( t[i].last > t[last].last )
+        t[last].last = t[i].last;
+    }
+    else
+    {
+      if ( ! t[i].weight )
+        last = j;
+
+      t[j++] = t[i];
+    }
+
+    i++;
+  }
+
+  return j;
+}
+
+/* Vose's alias method. */
+static void build_alias_table ( bucket_T *buckets, const target_T *t, uint32_t n )
+{
+  uint32_t *small, *large;
+  uint32_t ns, nl, s, l, i;
+  double *p, total;
+
+  p = malloc ( n * sizeof *p );
+  small = malloc ( n * sizeof *small );
+  large = malloc ( n * sizeof *large );
+
+  if ( ! p || ! small || ! large )
+    fatal_error ( "Cannot allocate memory for %u targets.", n );
+
+  total = 0;
+  i = 0;
+  while ( i < n )
+  {
+    total += t[i].weight ? t[i].weight : ( double ) t[i].last - t[i].first + 1;
+    i++;
+  }
+
+  /* Scaled probabilities: The average bucket is 1. */
+  ns = nl = 0;
+  i = 0;
+  while ( i < n )
+  {
+    p[i] = ( t[i].weight ? t[i].weight : ( double ) t[i].last - t[i].first + 1 ) * n / total;
+
+    if ( p[i] < 1.0 )
+      small[ns++] = i;
+    else
+      large[nl++] = i;
+
+    i++;
+  }
+
+  /* Every small bucket is filled up by a large one. */
+  while ( ns && nl )
+  {
+    s = small[--ns];
+    l = large[nl - 1];
+
+    buckets[s].prob = p[s] * 4294967296.0;
+    buckets[s].alias = l;
+
+    p[l] = ( p[l] + p[s] ) - 1.0;
+    if ( p[l] < 1.0 )
+    {
+      nl--;
+      small[ns++] = l;
+    }
+  }
+
+  /* The others are full (or are, but for rounding errors). */
+  while ( nl )
+  {
+    l = large[--nl];
+    buckets[l].prob = UINT32_MAX;
+    buckets[l].alias = l;
+  }
+
+  while ( ns )
+  {
+    s = small[--ns];
+    buckets[s].prob = UINT32_MAX;
+    buckets[s].alias = s;
+  }
+
+  free ( large );
+  free ( small );
+  free ( p );
+}
+
+static void load_list ( target_list_T *list, const char *filename,
+                        const char *name, _Bool quiet )
+{
+  target_T *t;
+  uint64_t addresses;
+  uint32_t n, i;
+
+  n = read_targets ( filename, &t );
+  n = merge_targets ( t, n );
+
+  list->ranges = malloc ( n * sizeof *list->ranges );
+  list->buckets = malloc ( n * sizeof *list->buckets );
+
+  if ( ! list->ranges || ! list->buckets )
+    fatal_error ( "Cannot allocate memory for %u targets.", n );
+
+  addresses = 0;
+  i = 0;
+  while ( i < n )
+  {
+    list->ranges[i].first = t[i].first;
+    list->ranges[i].hosts = t[i].last - t[i].first + 1;
+    addresses += list->ranges[i].hosts;
+    i++;
+  }
+
+  build_alias_table ( list->buckets, t, n );
+  list->num_ranges = n;
+
+  free ( t );
+
+  if ( ! quiet )
+    printf ( INFO "%u %s (%" PRIu64 " addresses) loaded from %s.\n",
+             n, name, addresses, filename );
+}
+
+void load_targets ( const config_options_T * const co )
+{
+  if ( co->targets )
+    load_list ( &targets, co->targets, "targets", co->quiet );
+
+  if ( co->sources )
+    load_list ( &sources, co->sources, "sources", co->quiet );
+}
+
+static inline uint32_t choose ( const target_list_T * const list )
+{
+  const range_T *r;
+  uint32_t i;
+
+  i = ( ( uint64_t ) RANDOM() * list->num_ranges ) >> 32;
+
+  if ( RANDOM() >= list->buckets[i].prob )
+    i = list->buckets[i].alias;
+
+  r = list->ranges + i;
+
+  return r->first + ( ( ( uint64_t ) RANDOM() * r->hosts ) >> 32 );
+}
+
+/* Chooses a destination address (in host order). */
+uint32_t next_target ( void )
+{
+  return choose ( &targets );
+}
+
+/* Chooses a source address (in host order). */
+uint32_t next_source ( void )
+{
+  return choose ( &sources );
+}
@@ -0,0 +1,484 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file template.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Packet templates.
+
+   Most of the packet is the same on every iteration. Modules which have a
+   template function build the packet only once (the image), and tell us
+   which fields change (the patches) and which checksums must be computed
+   again. On the main loop the image is copied, patched and checksummed.
+
+   Checksums aren't computed again: They are updated from the values on the
+   image, for each field changed (RFC 1624). The sum of the old values is
+   taken once, so only the new values are added for every packet. The GRE
+   checksum, for instance, is updated with the new addresses and the new
+   transport checksum, instead of summing up the whole packet again.
+
+   Templates are built on the first use (one per module, per worker).
+   Modules without a template function (or which refuse to build one, for
+   the given options) are called on every iteration, as usual. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <linux/ip.h>
+#include <t50_defines.h>
+#include <t50_errors.h>
+#include <t50_cksum.h>
+#include <t50_memalloc.h>
+#include <t50_modules.h>
+#include <t50_randomizer.h>
+#include <t50_template.h>
+
+/* NOTE: Every worker has its own templates. */
+static _Thread_local template_T *templates = NULL;
+
+static void create_template ( template_T * restrict, unsigned int, const config_options_T * const restrict,
+                              packet_buffer_T * restrict );
+static void prepare_cksums ( template_T * );
+
+/**
+ * Allocates the (empty) templates of the calling worker.
+ */
+void init_templates ( void )
+{
+  if ( ! ( templates = calloc ( number_of_modules, sizeof ( template_T ) ) ) )
+    fatal_error ( "Cannot allocate packet templates." );
+}
+
+void destroy_templates ( void )
+{
+  uint32_t i;
+
+  if ( templates )
+  {
+    i = 0;
+    while ( i < number_of_modules )
+    {
+      /* NOTE: SAFE_FREE() evaluates its argument more than once. */
+      SAFE_FREE ( templates[i].image );
+      i++;
+    }
+
+    SAFE_FREE ( templates );
+  }
+}
+
+/**
+ * Builds a packet from the module template.
+ *
+ * @param idx Module index (on modules table).
+ * @param co Pointer to T50 configuration structure.
+ * @param pb Pointer to the buffer where the packet is built.
+ * @param size Pointer to packet size (updated by the function).
+ * @return true if the packet was built, false if the module has no template.
+ */
+int build_from_template ( unsigned int idx,
+                          const config_options_T * const restrict co,
+                          packet_buffer_T * restrict pb,
+                          size_t * restrict size )
+{
+  template_T    *t;
+  const patch_T *p, *pend;
+  const csum_T  *c, *cend;
+  const term_T  *e, *eend;
+  void          *buffer;
+  uint32_t      value, sum, values[TEMPLATE_MAX_PATCHES];
+  uint16_t      check, checks[TEMPLATE_MAX_CSUMS];
+
+  t = &templates[idx];
+
+  /* NOTE: Assume the template is ready the majority of time. */
+  if ( t->state <= 0 )
+  {
+    if ( t->state < 0 )
+      return 0;
+
+    create_template ( t, idx, co, pb );
+
+    if ( t->state < 0 )
+      return 0;
+  }
+
+  /* NOTE: Local copy, so the compiler don't reload the pointer after each store. */
+  buffer = packet_reserve ( pb, t->size );
+  memcpy ( buffer, t->image, t->size );
+
+  /* Patch the fields which change.
+     NOTE: Fields may be unaligned, so memcpy() is used. */
+  p = t->patches;
+  pend = p + t->num_patches;
+  while ( p < pend )
+  {
+    switch ( p->source )
+    {
+      case PATCH_DADDR: value = co->ip.daddr; break;
+      case PATCH_SADDR: value = co->ip.saddr; break;
+      case PATCH_SPORT: value = co->source; break;
+      case PATCH_DPORT: value = co->dest; break;
+      default:          value = RANDOM();
+    }
+
+    switch ( p->width )
+    {
+      case 4:
+        values[p - t->patches] = value;
+        switch ( p->count )
+        {
+          case 3: memcpy ( buffer + p->offset[2], &value, 4 ); /* fall through */
+          case 2: memcpy ( buffer + p->offset[1], &value, 4 ); /* fall through */
+          default: memcpy ( buffer + p->offset[0], &value, 4 );
+        }
+        break;
+
+      case 2:
+        values[p - t->patches] = check = value;
+        switch ( p->count )
+        {
+          case 3: memcpy ( buffer + p->offset[2], &check, 2 ); /* fall through */
+          case 2: memcpy ( buffer + p->offset[1], &check, 2 ); /* fall through */
+          default: memcpy ( buffer + p->offset[0], &check, 2 );
+        }
+        break;
+
+      default:
+        * ( uint8_t * ) ( buffer + p->offset[0] ) = value;
+    }
+
+    p++;
+  }
+
+  /* And fix the checksums. */
+  c = t->csums;
+  cend = c + t->num_csums;
+  while ( c < cend )
+  {
+    if ( c->type == CSUM_BOGUS )
+      check = RANDOM();
+    else
+    {
+      if ( c->full )
+      {
+        memset ( buffer + c->offset, 0, 2 );
+        check = cksum ( buffer + c->start, c->length );
+      }
+      else
+      {
+        /* Add the new values of the changed fields (RFC 1624). */
+        sum = c->base;
+
+        e = c->terms;
+        eend = e + c->num_terms;
+        while ( e < eend )
+        {
+          if ( e->is_csum )
+            sum += checks[e->index];
+          else
+          {
+            value = values[e->index];
+            sum += ( value & 0xffffU ) + ( value >> 16 );
+          }
+
+          e++;
+        }
+
+        check = cksum_finish ( sum );
+      }
+
+      if ( c->type == CSUM_INET )
+        check = htons ( check );
+    }
+
+    memcpy ( buffer + c->offset, &check, 2 );
+    checks[c - t->csums] = check;
+    c++;
+  }
+
+  *size = t->size;
+  return 1;
+}
+
+/* Asks the module to build its template. */
+static void create_template ( template_T * restrict t,
+                              unsigned int idx,
+                              const config_options_T * const restrict co,
+                              packet_buffer_T * restrict pb )
+{
+  t->state = -1;
+  t->num_patches = t->num_csums = 0;
+
+  if ( mod_table[idx].template_func && mod_table[idx].template_func ( co, pb, t ) )
+  {
+    prepare_cksums ( t );
+    t->state = 1;
+  }
+}
+
+/* Adds a changed field to a checksum, if it is inside the checksummed block. */
+static void add_term ( csum_T *c, unsigned int index, _Bool is_csum,
+                       size_t offset, unsigned int width, uint32_t old )
+{
+  term_T *e;
+
+  if ( offset < c->start || offset + width > ( size_t ) c->start + c->length )
+    return;
+
+  /* Single bytes and fields not aligned to a word can't be updated. */
+  if ( width == 1 || ( ( offset - c->start ) & 1 ) || c->num_terms == TEMPLATE_MAX_TERMS )
+  {
+    c->full = 1;
+    return;
+  }
+
+  e = &c->terms[c->num_terms++];
+  e->index = index;
+  e->is_csum = is_csum;
+
+  c->base = cksum_remove ( c->base, old, width );
+}
+
+/* Gets the values on the image and the fields covered by each checksum. */
+static void prepare_cksums ( template_T *t )
+{
+  patch_T      *p;
+  csum_T       *c;
+  unsigned int i, j, k;
+  uint16_t     w;
+
+  i = 0;
+  while ( i < t->num_patches )
+  {
+    p = &t->patches[i++];
+
+    if ( p->width == 4 )
+      memcpy ( &p->old, t->image + p->offset[0], 4 );
+    else
+    {
+      memcpy ( &w, t->image + p->offset[0], 2 );
+      p->old = w;
+    }
+  }
+
+  k = 0;
+  while ( k < t->num_csums )
+  {
+    c = &t->csums[k];
+    memcpy ( &c->check, t->image + c->offset, 2 );
+    c->base = cksum_base ( c->type == CSUM_INET ? ntohs ( c->check ) : c->check );
+    c->full = 0;
+    c->num_terms = 0;
+
+    /* Patches, and all their mirrors. */
+    i = 0;
+    while ( i < t->num_patches )
+    {
+      p = &t->patches[i];
+
+      j = 0;
+      while ( j < p->count )
+        add_term ( c, i, 0, p->offset[j++], p->width, p->old );
+
+      i++;
+    }
+
+    /* Previous checksums. */
+    j = 0;
+    while ( j < k )
+    {
+      add_term ( c, j, 1, t->csums[j].offset, 2, t->csums[j].check );
+      j++;
+    }
+
+    k++;
+  }
+}
+
+/**
+ * Copies the packet image to the template.
+ *
+ * @param t Pointer to the template.
+ * @param image Pointer to the packet built by the module.
+ * @param size Size of the packet.
+ */
+void template_image ( template_T * restrict t, const void * restrict image, size_t size )
+{
+  if ( ! ( t->image = malloc ( size ) ) )
+    fatal_error ( "Cannot allocate packet template." );
+
+  memcpy ( t->image, image, size );
+  t->size = size;
+}
+
+/**
+ * Adds a field to be changed on every packet.
+ *
+ * @param t Pointer to the template.
+ * @param source Where the value comes from (PATCH_*).
+ * @param width Size of the field (1, 2 or 4 bytes).
+ * @param offset Offset of the field on the packet.
+ * @return Pointer to the patch (so mirrors can be added).
+ */
+patch_T *template_add_patch ( template_T *t, int source, unsigned int width, size_t offset )
+{
+  patch_T *p;
+
+  assert ( t->num_patches < TEMPLATE_MAX_PATCHES );
+  assert ( offset + width <= t->size );
+
+  p = &t->patches[t->num_patches++];
+  p->offset[0] = offset;
+  p->count = 1;
+  p->width = width;
+  p->source = source;
+
+  return p;
+}
+
+/**
+ * Adds another place where the patched value must be written.
+ *
+ * @param p Pointer to the patch.
+ * @param offset Offset of the field on the packet.
+ */
+void template_add_mirror ( patch_T *p, size_t offset )
+{
+  assert ( p->count < TEMPLATE_MAX_MIRRORS );
+
+  p->offset[p->count++] = offset;
+}
+
+/**
+ * Adds a checksum to be computed on every packet.
+ *
+ * NOTE: Checksums are computed in the order they are added.
+ *
+ * @param t Pointer to the template.
+ * @param type How to compute it (CSUM_*).
+ * @param offset Offset of the checksum field.
+ * @param start Offset of the checksummed block.
+ * @param length Size of the checksummed block.
+ */
+void template_add_cksum ( template_T *t, int type, size_t offset, size_t start, size_t length )
+{
+  csum_T *c;
+
+  assert ( t->num_csums < TEMPLATE_MAX_CSUMS );
+  assert ( start + length <= t->size );
+
+  c = &t->csums[t->num_csums++];
+  c->offset = offset;
+  c->start = start;
+  c->length = length;
+  c->type = type;
+}
+
+/**
+ * Adds the patches of IP header, GRE encapsulation (if any) and pseudo
+ * header (the same way ip_header() and gre_encapsulation() fill them).
+ *
+ * @param t Pointer to the template.
+ * @param co Pointer to T50 configuration structure.
+ * @param pseudo Offset of the pseudo header (0 if there is none).
+ */
+void template_add_ip ( template_T * restrict t,
+                       const config_options_T * const restrict co,
+                       size_t pseudo )
+{
+  patch_T *p;
+  size_t  gre_ip, offset;
+
+  /* Encapsulated IP header is the last thing on GRE options. */
+  gre_ip = gre_opt_len ( co );
+
+  if ( !co->ip.id )
+  {
+    p = template_add_patch ( t, PATCH_RANDOM, 2, offsetof ( struct iphdr, id ) );
+
+    if ( co->encapsulated )
+      template_add_mirror ( p, gre_ip + offsetof ( struct iphdr, id ) );
+  }
+
+  /* Pseudo header gets the encapsulated IP addresses, if any.
+     Source ranges and pools are chosen by the worker, as the destination. */
+  if ( !co->ip.saddr || co->sbits || co->sources )
+  {
+    p = template_add_patch ( t, co->sbits || co->sources ? PATCH_SADDR : PATCH_RANDOM,
+                             4, offsetof ( struct iphdr, saddr ) );
+
+    if ( co->encapsulated && !co->gre.saddr )
+      template_add_mirror ( p, gre_ip + offsetof ( struct iphdr, saddr ) );
+
+    if ( pseudo && ( !co->encapsulated || !co->gre.saddr ) )
+      template_add_mirror ( p, pseudo + offsetof ( struct psdhdr, saddr ) );
+  }
+
+  p = template_add_patch ( t, PATCH_DADDR, 4, offsetof ( struct iphdr, daddr ) );
+
+  if ( co->encapsulated && !co->gre.daddr )
+    template_add_mirror ( p, gre_ip + offsetof ( struct iphdr, daddr ) );
+
+  if ( pseudo && ( !co->encapsulated || !co->gre.daddr ) )
+    template_add_mirror ( p, pseudo + offsetof ( struct psdhdr, daddr ) );
+
+  if ( co->encapsulated )
+  {
+    /* GRE optional fields follow the GRE header. */
+    offset = sizeof ( struct iphdr ) + sizeof ( struct gre_hdr );
+
+    if ( co->gre.C )
+      offset += GRE_OPTLEN_CHECKSUM;
+
+    if ( co->gre.K )
+    {
+      if ( !co->gre.key )
+        template_add_patch ( t, PATCH_RANDOM, 4, offset );
+
+      offset += GRE_OPTLEN_KEY;
+    }
+
+    if ( co->gre.S && !co->gre.sequence )
+      template_add_patch ( t, PATCH_RANDOM, 4, offset );
+
+    template_add_cksum ( t, co->bogus_csum ? CSUM_BOGUS : CSUM_INET,
+                         gre_ip + offsetof ( struct iphdr, check ),
+                         gre_ip, sizeof ( struct iphdr ) );
+  }
+}
+
+/**
+ * Adds the GRE checksum, if any (same as gre_checksum()).
+ *
+ * NOTE: Must be the last one, since it covers all other checksums.
+ *
+ * @param t Pointer to the template.
+ * @param co Pointer to T50 configuration structure.
+ */
+void template_add_gre_cksum ( template_T * restrict t,
+                              const config_options_T * const restrict co )
+{
+  if ( co->encapsulated && co->gre.C )
+    template_add_cksum ( t, co->bogus_csum ? CSUM_BOGUS : CSUM_RAW,
+                         sizeof ( struct iphdr ) + sizeof ( struct gre_hdr ) +
+                         offsetof ( struct gre_sum_hdr, check ),
+                         sizeof ( struct iphdr ),
+                         t->size - sizeof ( struct iphdr ) );
+}
@@ -0,0 +1,352 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file txring.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* AF_PACKET TX_RING backend.
+
+   Packets are built directly on the frames of a TPACKET_V3 transmit ring,
+   shared with the kernel through mmap(). Each frame is marked as ready
+   (TP_STATUS_SEND_REQUEST) and the kernel is kicked with a single send()
+   for each batch of frames. No copies, no per packet syscalls.
+
+   The socket is SOCK_DGRAM, so the kernel builds the ethernet header, using
+   the destination MAC address given by --dmac. */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#include <linux/ip.h>
+#include <t50_defines.h>
+#include <t50_errors.h>
+#include <t50_cksum.h>
+#include <t50_netio.h>
+#include <t50_backends.h>
+
+/* Ring geometry: 64 blocks of 64 KiB, with 2 KiB frames (2048 frames). */
+#define TXRING_FRAME_SIZE   TX_SLOT_SIZE
+#define TXRING_BLOCK_SIZE   65536
+#define TXRING_BLOCK_NR     64
+#define TXRING_FRAME_NR     ( ( TXRING_BLOCK_SIZE / TXRING_FRAME_SIZE ) * TXRING_BLOCK_NR )
+
+/* Packet data offset inside a frame (SOCK_DGRAM, no PACKET_TX_HAS_OFF). */
+#define TXRING_DATA_OFFSET  TPACKET_ALIGN ( sizeof ( struct tpacket3_hdr ) )
+
+/* NOTE: Every worker has its own socket and rings. */
+static _Thread_local int                 fd = -1;
+static _Thread_local void               *ring = MAP_FAILED;
+static _Thread_local unsigned int        frame_idx = 0;     /* Next frame to be filled. */
+static _Thread_local unsigned int        kick_every = 1;    /* Frames per kick. */
+static _Thread_local unsigned int        pending = 0;       /* Frames filled, not kicked yet. */
+static _Thread_local uint64_t            pending_bytes = 0;
+static _Thread_local struct sockaddr_ll  sll;
+
+static int  txring_kick ( void );
+static void txring_drop ( void );
+
+static inline struct tpacket3_hdr *get_frame ( unsigned int idx )
+{
+  return ring + ( size_t ) idx * TXRING_FRAME_SIZE;
+}
+
+/* Creates the AF_PACKET socket and maps the transmit ring. */
+void txring_create ( const config_options_T * const restrict co )
+{
+  struct tpacket_req3 req;
+  int n;
+
+  if ( ( fd = socket ( AF_PACKET, SOCK_DGRAM, 0 ) ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot open packet socket: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot open packet socket" );
+#endif
+  }
+
+  /* Destination address for every frame on the ring. */
+  memset ( &sll, 0, sizeof sll );
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons ( ETH_P_IP );
+  sll.sll_ifindex = get_iface_index ( co->iface );
+  sll.sll_halen = ETH_ALEN;
+  memcpy ( sll.sll_addr, co->dmac, ETH_ALEN );
+
+  /* Bind without receiving anything (protocol 0). */
+  {
+    struct sockaddr_ll bsll = { .sll_family = AF_PACKET,
+                                .sll_ifindex = sll.sll_ifindex };
+
+    if ( bind ( fd, ( struct sockaddr * ) &bsll, sizeof bsll ) == -1 )
+    {
+#ifndef NDEBUG
+      fatal_error ( "Cannot bind packet socket to %s: \"%s\"", co->iface, strerror ( errno ) );
+#else
+      fatal_error ( "Cannot bind packet socket to %s", co->iface );
+#endif
+    }
+  }
+
+  n = TPACKET_V3;
+  if ( setsockopt ( fd, SOL_PACKET, PACKET_VERSION, &n, sizeof n ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot set TPACKET_V3: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot set TPACKET_V3" );
+#endif
+  }
+
+#ifdef PACKET_QDISC_BYPASS
+  if ( co->qdisc_bypass )
+  {
+    n = 1;
+    if ( setsockopt ( fd, SOL_PACKET, PACKET_QDISC_BYPASS, &n, sizeof n ) == -1 )
+      error ( "Cannot bypass the qdisc layer. Ignoring." );
+  }
+#endif
+
+  /* NOTE: Block transmission isn't supported by the kernel. The TX ring is
+           handled frame by frame and the block specific fields must be 0. */
+  memset ( &req, 0, sizeof req );
+  req.tp_block_size = TXRING_BLOCK_SIZE;
+  req.tp_block_nr = TXRING_BLOCK_NR;
+  req.tp_frame_size = TXRING_FRAME_SIZE;
+  req.tp_frame_nr = TXRING_FRAME_NR;
+
+  if ( setsockopt ( fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof req ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot setup the transmit ring: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot setup the transmit ring" );
+#endif
+  }
+
+  if ( ( ring = mmap ( NULL, ( size_t ) TXRING_BLOCK_SIZE * TXRING_BLOCK_NR,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, 0 ) ) == MAP_FAILED )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot map the transmit ring: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot map the transmit ring" );
+#endif
+  }
+
+  /* The ring must have room for, at least, two batches. */
+  kick_every = co->batch;
+  if ( kick_every > TXRING_FRAME_NR / 2 )
+    kick_every = TXRING_FRAME_NR / 2;
+
+  frame_idx = pending = 0;
+  pending_bytes = 0;
+}
+
+void txring_close ( void )
+{
+  if ( ring != MAP_FAILED )
+  {
+    munmap ( ring, ( size_t ) TXRING_BLOCK_SIZE * TXRING_BLOCK_NR );
+    ring = MAP_FAILED;
+  }
+
+  if ( fd > 0 )
+  {
+    close ( fd );
+    fd = -1;
+  }
+}
+
+/* Waits for the next frame to be released by the kernel and returns
+   the place where the packet must be built. */
+void *txring_get_slot ( size_t *size )
+{
+  struct tpacket3_hdr *hdr;
+
+  while ( __atomic_load_n ( &( hdr = get_frame ( frame_idx ) )->tp_status, __ATOMIC_ACQUIRE ) &
+          ( TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING ) )
+  {
+    /* Ring is full. Make sure the kernel knows about the pending frames
+       (NOTE: if they are dropped, frame_idx goes back to a free frame)
+       or wait for it. */
+    if ( !pending || !txring_kick() )
+      wait_for_io ( fd, POLLOUT );
+  }
+
+  *size = TXRING_FRAME_SIZE - TXRING_DATA_OFFSET;
+  return ( void * ) hdr + TXRING_DATA_OFFSET;
+}
+
+/* Hands the frame over to the kernel. */
+int txring_send ( const void * const buffer,
+                  size_t size,
+                  const config_options_T * const restrict co __attribute__((unused)) )
+{
+  struct tpacket3_hdr *hdr;
+  struct iphdr *ip;
+  void *slot;
+
+  hdr = get_frame ( frame_idx );
+  slot = ( void * ) hdr + TXRING_DATA_OFFSET;
+
+  /* Packet not built in place? Copy it! */
+  if ( buffer != slot )
+  {
+    if ( size > TXRING_FRAME_SIZE - TXRING_DATA_OFFSET )
+      fatal_error ( "Packet (%zu bytes) is too big for the transmit slot.", size );
+
+    memcpy ( slot, buffer, size );
+  }
+
+  /* There is no kernel IP layer here: The IP header checksum is ours. */
+  ip = slot;
+  ip->check = 0;
+  ip->check = cksum ( ip, ip->ihl * 4 );
+
+  hdr->tp_len = size;
+  hdr->tp_snaplen = size;
+  hdr->tp_next_offset = 0;
+  __atomic_store_n ( &hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE );
+
+  if ( ++frame_idx == TXRING_FRAME_NR )
+    frame_idx = 0;
+
+  pending_bytes += size;
+  if ( ++pending < kick_every )
+    return 1;
+
+  return txring_kick();
+}
+
+int txring_flush ( void )
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+  unsigned int idx;
+
+  if ( pending && !txring_kick() )
+    return 0;
+
+  /* Wait for all frames to leave the ring, before closing the socket. */
+  idx = 0;
+  while ( idx < TXRING_FRAME_NR )
+  {
+    if ( __atomic_load_n ( &get_frame ( idx )->tp_status, __ATOMIC_ACQUIRE ) &
+         ( TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING ) )
+      poll ( &pfd, 1, 1 );
+    else
+      idx++;
+  }
+
+  return 1;
+}
+
+/* Tells the kernel to transmit all frames marked as ready.
+   NOTE: MSG_DONTWAIT avoids waiting for all frames to be transmitted. */
+static int txring_kick ( void )
+{
+  unsigned int tries;
+
+  tries = 0;
+  while ( sendto ( fd, NULL, 0, MSG_DONTWAIT, ( struct sockaddr * ) &sll, sizeof sll ) == -1 )
+  {
+    switch ( errno )
+    {
+      case EINTR:
+        continue;
+
+      /* Same as socket_send() (netio.c). The frames the kernel didn't
+         take stay on the ring, for the next try. */
+      case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+      case EWOULDBLOCK:
+#endif
+      case ENOBUFS:
+        if ( backpressure ( fd, &tries ) )
+          continue;
+
+        txring_drop();
+        return 1;
+
+      case EPERM:
+        fatal_error ( "Cannot send packet (Permission!?). Please check your firewall rules (iptables?)." );
+    }
+
+    return 0;
+  }
+
+  tx_stats->packets_sent += pending;
+  tx_stats->bytes_sent += pending_bytes;
+  pending = 0;
+  pending_bytes = 0;
+
+  return 1;
+}
+
+/* Gives up the pending frames the kernel didn't take, yet.
+
+   The kernel takes the frames in order and stops on the first one it
+   cannot send, so they are the last ones filled. They are marked as free
+   again and frame_idx goes back to the first of them (where the kernel
+   will look for the next frame), so the ring has no holes. */
+static void txring_drop ( void )
+{
+  struct tpacket3_hdr *hdr;
+  unsigned int idx;
+
+  idx = ( frame_idx + TXRING_FRAME_NR - pending ) % TXRING_FRAME_NR;
+
+  /* These ones were taken. */
+  while ( pending )
+  {
+    hdr = get_frame ( idx );
+    if ( __atomic_load_n ( &hdr->tp_status, __ATOMIC_ACQUIRE ) & TP_STATUS_SEND_REQUEST )
+      break;
+
+    tx_stats->packets_sent++;
+    tx_stats->bytes_sent += hdr->tp_len;
+
+    if ( ++idx == TXRING_FRAME_NR )
+      idx = 0;
+
+    pending--;
+  }
+
+  tx_stats->packets_dropped += pending;
+  frame_idx = idx;
+
+  while ( pending )
+  {
+    __atomic_store_n ( &get_frame ( idx )->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE );
+
+    if ( ++idx == TXRING_FRAME_NR )
+      idx = 0;
+
+    pending--;
+  }
+
+  pending_bytes = 0;
+}
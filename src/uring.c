@@ -0,0 +1,435 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file uring.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* io_uring backend.
+
+   Each packet is built on its own slot and submitted, through the raw
+   socket, as an IORING_OP_SENDMSG request. Requests are submitted once
+   every --batch packets and the slots are recycled as completions arrive,
+   so packet building overlaps with transmission.
+
+   With --sqpoll a kernel thread polls the submission queue, and the main
+   loop makes no syscalls at all while the thread is awake.
+
+   NOTE: liburing isn't used. The rings are mapped directly. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#include <t50_defines.h>
+#include <t50_errors.h>
+#include <t50_netio.h>
+#include <t50_randomizer.h>
+#include <t50_backends.h>
+
+/* Number of slots (and submission queue entries).
+   The completion queue is twice as big, so it never overflows. */
+#define URING_ENTRIES     1024
+
+/* SQPOLL thread idle time, in milliseconds. */
+#define URING_SQ_IDLE     1000
+
+/* Each slot holds a packet and everything sendmsg() needs. */
+struct uring_slot
+{
+  struct msghdr      msg;
+  struct iovec       iov;
+  struct sockaddr_in sin;
+};
+
+/* NOTE: Every worker has its own socket and rings. */
+static _Thread_local int                   fd = -1;
+static _Thread_local int                   ring_fd = -1;
+static _Thread_local _Bool                 sqpoll = 0;
+
+/* Submission queue. */
+static _Thread_local void                 *sq_map = MAP_FAILED;
+static _Thread_local size_t                sq_map_len;
+static _Thread_local uint32_t             *sq_tail;
+static _Thread_local uint32_t             *sq_flags;
+static _Thread_local uint32_t              sq_mask;
+static _Thread_local uint32_t              sq_local_tail;
+static _Thread_local struct io_uring_sqe  *sqes = MAP_FAILED;
+
+/* Completion queue. */
+static _Thread_local void                 *cq_map = MAP_FAILED;
+static _Thread_local size_t                cq_map_len;
+static _Thread_local uint32_t             *cq_head;
+static _Thread_local uint32_t             *cq_tail;
+static _Thread_local uint32_t              cq_mask;
+static _Thread_local struct io_uring_cqe  *cqes;
+
+/* Packet slots. */
+static _Thread_local struct uring_slot    *slots = NULL;
+static _Thread_local void                 *buffers = NULL;
+static _Thread_local uint32_t             *free_slots = NULL;   /* Stack of free slots. */
+static _Thread_local unsigned int          free_nr = 0;
+static _Thread_local unsigned int          kick_every = 1;
+static _Thread_local unsigned int          pending = 0;         /* SQEs not submitted yet. */
+
+static void         uring_submit ( void );
+static unsigned int uring_reap ( void );
+static void         uring_wait ( void );
+
+static inline int io_uring_setup ( unsigned int entries, struct io_uring_params *p )
+{
+  return syscall ( __NR_io_uring_setup, entries, p );
+}
+
+static inline int io_uring_enter ( unsigned int to_submit, unsigned int min_complete, unsigned int flags )
+{
+  return syscall ( __NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0 );
+}
+
+/* Creates the raw socket, the io_uring instance and the slots. */
+void uring_create ( const config_options_T * const restrict co )
+{
+  struct io_uring_params p;
+  uint32_t *sq_array;
+  unsigned int i;
+
+  /* NOTE: The socket must block. On non-blocking sockets io_uring
+           completes the requests with -EAGAIN instead of waiting. */
+  fd = raw_socket ( co, 0 );
+
+  memset ( &p, 0, sizeof p );
+  p.cq_entries = URING_ENTRIES * 2;
+  p.flags = IORING_SETUP_CQSIZE;
+  if ( ( sqpoll = co->sqpoll ) )
+  {
+    p.flags |= IORING_SETUP_SQPOLL;
+    p.sq_thread_idle = URING_SQ_IDLE;
+  }
+
+  if ( ( ring_fd = io_uring_setup ( URING_ENTRIES, &p ) ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot setup io_uring: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot setup io_uring" );
+#endif
+  }
+
+  sq_map_len = p.sq_off.array + p.sq_entries * sizeof ( uint32_t );
+  cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof ( struct io_uring_cqe );
+
+  /* Since kernel 5.4 both rings can be mapped at once. */
+  if ( p.features & IORING_FEAT_SINGLE_MMAP )
+  {
+    if ( cq_map_len > sq_map_len )
+      sq_map_len = cq_map_len;
+    cq_map_len = sq_map_len;
+  }
+
+  if ( ( sq_map = mmap ( NULL, sq_map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_SQ_RING ) ) == MAP_FAILED )
+    goto map_error;
+
+  if ( p.features & IORING_FEAT_SINGLE_MMAP )
+    cq_map = sq_map;
+  else if ( ( cq_map = mmap ( NULL, cq_map_len, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring_fd,
+                              IORING_OFF_CQ_RING ) ) == MAP_FAILED )
+    goto map_error;
+
+  if ( ( sqes = mmap ( NULL, p.sq_entries * sizeof ( struct io_uring_sqe ),
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_SQES ) ) == MAP_FAILED )
+    goto map_error;
+
+  sq_tail = sq_map + p.sq_off.tail;
+  sq_flags = sq_map + p.sq_off.flags;
+  sq_mask = *( uint32_t * ) ( sq_map + p.sq_off.ring_mask );
+  sq_array = sq_map + p.sq_off.array;
+  sq_local_tail = *sq_tail;
+
+  cq_head = cq_map + p.cq_off.head;
+  cq_tail = cq_map + p.cq_off.tail;
+  cq_mask = *( uint32_t * ) ( cq_map + p.cq_off.ring_mask );
+  cqes = cq_map + p.cq_off.cqes;
+
+  if ( ! ( slots = calloc ( URING_ENTRIES, sizeof ( struct uring_slot ) ) ) ||
+       ! ( buffers = malloc ( ( size_t ) URING_ENTRIES * TX_SLOT_SIZE ) ) ||
+       ! ( free_slots = malloc ( URING_ENTRIES * sizeof ( uint32_t ) ) ) )
+    fatal_error ( "Cannot allocate io_uring slots." );
+
+  /* SQE index i is always at the array position i. Every slot is free. */
+  i = 0;
+  while ( i < URING_ENTRIES )
+  {
+    sq_array[i] = i;
+
+    slots[i].iov.iov_base = buffers + i * TX_SLOT_SIZE;
+    slots[i].msg.msg_name = &slots[i].sin;
+    slots[i].msg.msg_namelen = sizeof ( struct sockaddr_in );
+    slots[i].msg.msg_iov = &slots[i].iov;
+    slots[i].msg.msg_iovlen = 1;
+    slots[i].sin.sin_family = AF_INET;
+
+    free_slots[i] = URING_ENTRIES - 1 - i;
+    i++;
+  }
+  free_nr = URING_ENTRIES;
+
+  kick_every = co->batch;
+  if ( kick_every > URING_ENTRIES / 2 )
+    kick_every = URING_ENTRIES / 2;
+
+  pending = 0;
+  return;
+
+map_error:
+#ifndef NDEBUG
+  fatal_error ( "Cannot map io_uring rings: \"%s\"", strerror ( errno ) );
+#else
+  fatal_error ( "Cannot map io_uring rings" );
+#endif
+}
+
+void uring_close ( void )
+{
+  if ( sqes != MAP_FAILED )
+    munmap ( sqes, URING_ENTRIES * sizeof ( struct io_uring_sqe ) );
+
+  if ( cq_map != MAP_FAILED && cq_map != sq_map )
+    munmap ( cq_map, cq_map_len );
+
+  if ( sq_map != MAP_FAILED )
+    munmap ( sq_map, sq_map_len );
+
+  sqes = cq_map = sq_map = MAP_FAILED;
+
+  if ( ring_fd > 0 )
+  {
+    close ( ring_fd );
+    ring_fd = -1;
+  }
+
+  if ( fd > 0 )
+  {
+    close ( fd );
+    fd = -1;
+  }
+
+  SAFE_FREE ( slots );
+  SAFE_FREE ( buffers );
+  SAFE_FREE ( free_slots );
+  free_nr = 0;
+}
+
+/* Gets the next free slot, waiting for completions if necessary. */
+void *uring_get_slot ( size_t *size )
+{
+  if ( ! free_nr )
+    uring_wait();
+
+  *size = TX_SLOT_SIZE;
+  return slots[free_slots[free_nr - 1]].iov.iov_base;
+}
+
+/* Queues the SENDMSG request. */
+int uring_send ( const void * const buffer,
+                 size_t size,
+                 const config_options_T * const restrict co )
+{
+  struct io_uring_sqe *sqe;
+  struct uring_slot *slot;
+  uint32_t idx;
+
+  if ( ! free_nr )
+    uring_wait();
+
+  idx = free_slots[--free_nr];
+  slot = &slots[idx];
+
+  /* Packet not built in place? Copy it! */
+  if ( buffer != slot->iov.iov_base )
+  {
+    if ( size > TX_SLOT_SIZE )
+      fatal_error ( "Packet (%zu bytes) is too big for the transmit slot.", size );
+
+    memcpy ( slot->iov.iov_base, buffer, size );
+  }
+
+  slot->iov.iov_len = size;
+  slot->sin.sin_port = htons ( IPPORT_RND ( co->dest ) );
+  slot->sin.sin_addr.s_addr = co->ip.daddr;
+
+  sqe = &sqes[sq_local_tail & sq_mask];
+  memset ( sqe, 0, sizeof *sqe );
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = ( uintptr_t ) &slot->msg;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = idx;
+  sq_local_tail++;
+
+  if ( ++pending >= kick_every )
+    uring_submit();
+
+  /* Recycle the slots already sent, if any. */
+  uring_reap();
+
+  return 1;
+}
+
+int uring_flush ( void )
+{
+  if ( pending )
+    uring_submit();
+
+  /* Wait for all requests to complete, before closing the socket. */
+  uring_reap();
+  while ( free_nr < URING_ENTRIES )
+  {
+    if ( io_uring_enter ( 0, URING_ENTRIES - free_nr, IORING_ENTER_GETEVENTS ) == -1 &&
+         errno != EINTR )
+      return 0;
+
+    uring_reap();
+  }
+
+  return 1;
+}
+
+/* Makes the queued requests visible to the kernel and, if there is no
+   polling thread awake, submits them. */
+static void uring_submit ( void )
+{
+  unsigned int n;
+  int r;
+
+  __atomic_store_n ( sq_tail, sq_local_tail, __ATOMIC_RELEASE );
+  n = pending;
+  pending = 0;
+
+  if ( sqpoll )
+  {
+    /* NOTE: Full barrier between the tail store and the flags load,
+             as required by the SQPOLL wakeup protocol. */
+    __atomic_thread_fence ( __ATOMIC_SEQ_CST );
+    if ( __atomic_load_n ( sq_flags, __ATOMIC_RELAXED ) & IORING_SQ_NEED_WAKEUP )
+      io_uring_enter ( 0, 0, IORING_ENTER_SQ_WAKEUP );
+
+    return;
+  }
+
+  /* NOTE: The kernel may take only some of the requests. */
+  while ( n )
+  {
+    if ( ( r = io_uring_enter ( n, 0, 0 ) ) > 0 )
+    {
+      n -= r;
+      continue;
+    }
+
+    if ( r == -1 )
+      switch ( errno )
+      {
+        case EINTR:
+          continue;
+
+        case EAGAIN:
+        case EBUSY:
+          break;
+
+        default:
+#ifndef NDEBUG
+          fatal_error ( "Cannot submit to io_uring: \"%s\"", strerror ( errno ) );
+#else
+          fatal_error ( "Cannot submit to io_uring" );
+#endif
+      }
+
+    /* Completion queue full (or the kernel is out of resources):
+       Nothing is submitted until some completions are taken out of it,
+       so reap them or wait for them. */
+    if ( ! uring_reap() )
+      wait_for_io ( ring_fd, POLLIN );
+  }
+}
+
+/* Process the completions, recycling the slots.
+   Returns the number of completions. */
+static unsigned int uring_reap ( void )
+{
+  struct io_uring_cqe *cqe;
+  uint32_t head, tail, n;
+
+  head = *cq_head;
+  tail = __atomic_load_n ( cq_tail, __ATOMIC_ACQUIRE );
+  n = tail - head;
+
+  while ( head != tail )
+  {
+    cqe = &cqes[head & cq_mask];
+
+    if ( cqe->res >= 0 )
+    {
+      tx_stats->packets_sent++;
+      tx_stats->bytes_sent += cqe->res;
+    }
+    else if ( cqe->res == -EPERM )
+      fatal_error ( "Cannot send packet (Permission!?). Please check your firewall rules (iptables?)." );
+    else
+    {
+      /* Failed sends (-ENOBUFS, -EHOSTUNREACH, ...) are lost. */
+      tx_stats->packets_dropped++;
+#ifndef NDEBUG
+      error ( "Packet (%zu bytes long) not sent: \"%s\"",
+              slots[cqe->user_data].iov.iov_len, strerror ( -cqe->res ) );
+#endif
+    }
+
+    free_slots[free_nr++] = cqe->user_data;
+    head++;
+  }
+
+  __atomic_store_n ( cq_head, head, __ATOMIC_RELEASE );
+
+  return n;
+}
+
+/* Waits for, at least, one completion.
+   NOTE: The io_uring descriptor is readable when there are completions. */
+static void uring_wait ( void )
+{
+  if ( pending )
+    uring_submit();
+
+  uring_reap();
+  while ( ! free_nr )
+  {
+    wait_for_io ( ring_fd, POLLIN );
+    uring_reap();
+  }
+}
@@ -0,0 +1,1025 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file workers.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Workers engine.
+
+   Each worker is a thread with its own copy of the configuration, its own
+   socket (and transmit backend state), packet buffer, random seed and
+   statistics. Nothing is shared on the main loop, except the read-only
+   CIDR and modules tables.
+
+   The threshold is partitioned exactly between the workers. A single
+   worker runs on the main thread.
+
+   Workers may be pinned to CPUs (--cpus). By default, if an interface
+   is given, they are pinned to the CPUs of the interface NUMA node. The
+   worker pins itself before allocating anything, so its packet buffer,
+   socket and rings are on its local node (first touch).
+
+   With --pipeline, the worker only sends: Its packets are built by its
+   builder threads (each one with its own generator and ring, see
+   pipeline.c) and the worker drains their rings in bursts. */
+
+// Needed for pthread_setaffinity_np() and CPU_* macros.
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <t50_defines.h>
+#include <t50_corpus.h>
+#include <t50_errors.h>
+#include <t50_memalloc.h>
+#include <t50_modules.h>
+#include <t50_netio.h>
+#include <t50_pacing.h>
+#include <t50_pipeline.h>
+#include <t50_ports.h>
+#include <t50_randomizer.h>
+#include <t50_shuffle.h>
+#include <t50_targets.h>
+#include <t50_template.h>
+#include <t50_workers.h>
+
+/* Packets sent from each ring, at once, by the pipeline sender. */
+#define PIPELINE_BURST 64
+
+/* Packets built at once, by the batch functions of the modules. */
+#define BUILD_BATCH 32
+
+typedef struct builder_s builder_T;
+
+/* Worker private data. */
+typedef struct
+{
+  pthread_t               tid;
+  unsigned int            id;
+  config_options_T        co;
+  const struct cidr      *cidr;
+  const struct cidr      *source;     /* Source addresses (--saddr). */
+  int                     cpu;        /* CPU the worker is pinned to (-1 if none). */
+  builder_T              *builders;   /* Pipeline builders (--pipeline). */
+  unsigned int            num_builders;
+  tx_stats_T              stats;      /* NOTE: cache aligned. */
+} _CACHE_ALIGNED worker_T;
+
+/* Pipeline builder private data. */
+struct builder_s
+{
+  pthread_t               tid;
+  unsigned int            id;         /* Generator index (for all workers). */
+  worker_T               *worker;
+  ring_T                 *ring;
+  config_options_T        co;
+} _CACHE_ALIGNED;
+
+/* Packet generator state (of a worker or a builder). */
+typedef struct
+{
+  config_options_T       *co;
+  const struct cidr      *cidr;
+  const struct cidr      *source;
+  sweep_T                 sweep, source_sweep;
+  modules_table_T        *ptbl;
+  int                     proto;
+  uint32_t                run;        /* Packets of the current protocol (T50). */
+  packet_buffer_T         buffer;     /* Arena slot (if there is no transmit slot). */
+} generator_T;
+
+_Thread_local unsigned int worker_id = 0;
+
+static worker_T     *workers = NULL;
+static unsigned int  num_workers = 0;
+static cpu_set_t     allowed_cpus;      /* Where the builders may run. */
+
+/* --pregen: The workers start sending together, after building their
+   corpus (pregen_time is the time it took, in nanoseconds). */
+static pthread_barrier_t pregen_barrier;
+static struct timespec   pregen_start;
+static uint64_t          pregen_time = 0;
+
+static void             *worker ( void * );
+static void             *builder ( void * );
+static void              run_pipeline ( worker_T * );
+static void              run_corpus ( worker_T * );
+static modules_table_T  *select_protocol ( const config_options_T *restrict, int *restrict );
+static int               parse_cpu_list ( const char *, cpu_set_t * );
+static int               get_iface_cpus ( const char *, cpu_set_t * );
+
+/**
+ * Creates the workers and waits for them.
+ *
+ * @param co Pointer to configurations for T50.
+ * @param cidr Pointer to destination addresses cidr.
+ * @param source Pointer to source addresses cidr.
+ */
+void run_workers ( const config_options_T * const restrict co,
+                   const struct cidr * const restrict cidr,
+                   const struct cidr * const restrict source )
+{
+  sigset_t sigset, oldset;
+  cpu_set_t cpus;
+  int cpu, ncpus;
+  unsigned int i;
+
+  num_workers = co->workers;
+
+  /* NOTE: Before any worker is pinned (the main thread may be one). */
+  if ( sched_getaffinity ( 0, sizeof allowed_cpus, &allowed_cpus ) )
+    CPU_ZERO ( &allowed_cpus );
+
+  if ( posix_memalign ( ( void ** ) &workers, CACHE_LINE_SIZE, num_workers * sizeof ( worker_T ) ) )
+    fatal_error ( "Cannot allocate workers." );
+
+  /* Get the CPUs the workers will be pinned to. */
+  ncpus = 0;
+  if ( co->cpus )
+  {
+    if ( ! parse_cpu_list ( co->cpus, &cpus ) )
+      fatal_error ( "Invalid CPU list '%s'.", co->cpus );
+
+    ncpus = CPU_COUNT ( &cpus );
+  }
+  else if ( co->iface && get_iface_cpus ( co->iface, &cpus ) )
+  {
+    /* Use only the node CPUs we are allowed to run on. */
+    if ( CPU_COUNT ( &allowed_cpus ) )
+      CPU_AND ( &cpus, &cpus, &allowed_cpus );
+
+    ncpus = CPU_COUNT ( &cpus );
+  }
+
+  /* Distribute the number of packets (and the CPUs) between workers. */
+  cpu = -1;
+  i = 0;
+  while ( i < num_workers )
+  {
+    memset ( &workers[i], 0, sizeof ( worker_T ) );
+    workers[i].id = i;
+    workers[i].co = *co;
+    workers[i].cidr = cidr;
+    workers[i].source = source;
+    workers[i].co.threshold = co->threshold / num_workers +
+                              ( i < co->threshold % num_workers );
+
+    /* And the rate, too. */
+    workers[i].co.pps = co->pps / num_workers + ( i < co->pps % num_workers );
+    workers[i].co.bps = co->bps / num_workers + ( i < co->bps % num_workers );
+
+    /* Round robin on the CPUs list. */
+    workers[i].cpu = -1;
+    if ( ncpus )
+    {
+      do
+        if ( ++cpu >= CPU_SETSIZE )
+          cpu = 0;
+      while ( ! CPU_ISSET ( cpu, &cpus ) );
+
+      workers[i].cpu = cpu;
+    }
+
+    i++;
+  }
+
+  if ( co->pregen )
+  {
+    pthread_barrier_init ( &pregen_barrier, NULL, num_workers );
+    clock_gettime ( CLOCK_MONOTONIC, &pregen_start );
+  }
+
+  /* Single worker runs on this thread. */
+  if ( num_workers == 1 )
+  {
+    worker ( workers );
+    return;
+  }
+
+  /* Signals are handled only by the main thread.
+     NOTE: The threads inherit the signal mask. */
+  sigfillset ( &sigset );
+  pthread_sigmask ( SIG_BLOCK, &sigset, &oldset );
+
+  i = 0;
+  while ( i < num_workers )
+  {
+    if ( pthread_create ( &workers[i].tid, NULL, worker, &workers[i] ) )
+      fatal_error ( "Cannot create worker #%u.", i );
+
+    i++;
+  }
+
+  pthread_sigmask ( SIG_SETMASK, &oldset, NULL );
+
+  i = 0;
+  while ( i < num_workers )
+    pthread_join ( workers[i++].tid, NULL );
+}
+
+/**
+ * Gets the number of workers.
+ */
+unsigned int get_num_workers ( void )
+{
+  return num_workers;
+}
+
+/**
+ * Gets the statistics of a single worker.
+ *
+ * @param n Worker index.
+ * @param stats Pointer to the structure where the statistics will be stored.
+ * @return CPU the worker is pinned to (-1 if none).
+ */
+int get_worker_statistics ( unsigned int n, tx_stats_T *stats )
+{
+  tx_stats_T *s = &workers[n].stats;
+
+  stats->bytes_sent = __atomic_load_n ( &s->bytes_sent, __ATOMIC_RELAXED );
+  stats->packets_sent = __atomic_load_n ( &s->packets_sent, __ATOMIC_RELAXED );
+  stats->packets_dropped = __atomic_load_n ( &s->packets_dropped, __ATOMIC_RELAXED );
+  stats->send_retries = __atomic_load_n ( &s->send_retries, __ATOMIC_RELAXED );
+  stats->io_waits = __atomic_load_n ( &s->io_waits, __ATOMIC_RELAXED );
+  stats->blocked_time = __atomic_load_n ( &s->blocked_time, __ATOMIC_RELAXED );
+
+  return workers[n].cpu;
+}
+
+/**
+ * Sums up the statistics of all workers.
+ *
+ * May be called while workers are running (on exit, for instance).
+ *
+ * @param total Pointer to the structure where the sums will be stored.
+ */
+void get_statistics ( tx_stats_T *total )
+{
+  tx_stats_T s;
+  unsigned int i;
+
+  memset ( total, 0, sizeof *total );
+
+  i = 0;
+  while ( i < num_workers )
+  {
+    get_worker_statistics ( i++, &s );
+
+    total->bytes_sent += s.bytes_sent;
+    total->packets_sent += s.packets_sent;
+    total->packets_dropped += s.packets_dropped;
+    total->send_retries += s.send_retries;
+    total->io_waits += s.io_waits;
+    total->blocked_time += s.blocked_time;
+  }
+}
+
+/**
+ * Sums up the pipeline statistics of all rings.
+ *
+ * May be called while workers are running (on exit, for instance).
+ *
+ * @param total Pointer to the structure where the sums will be stored.
+ * @return Number of rings (0 if the pipeline isn't used).
+ */
+unsigned int get_pipeline_statistics ( pipeline_stats_T *total )
+{
+  unsigned int i, j, n, rings;
+
+  memset ( total, 0, sizeof *total );
+
+  rings = 0;
+  i = 0;
+  while ( i < num_workers )
+  {
+    n = __atomic_load_n ( &workers[i].num_builders, __ATOMIC_ACQUIRE );
+
+    j = 0;
+    while ( j < n )
+      ring_statistics ( workers[i].builders[j++].ring, total );
+
+    rings += n;
+    i++;
+  }
+
+  return rings;
+}
+
+/**
+ * Gets the time spent building the corpus (--pregen), in nanoseconds.
+ */
+uint64_t get_pregen_time ( void )
+{
+  return __atomic_load_n ( &pregen_time, __ATOMIC_RELAXED );
+}
+
+/* Gets an address of the CIDR (in host order): A random one or, with
+   --permute, the next of the worker sweep. */
+static inline uint32_t get_host ( const struct cidr * const cidr_ptr, sweep_T *sweep, _Bool permute )
+{
+  uint32_t addr;
+
+  addr = cidr_ptr->__1st_addr;
+
+  if ( cidr_ptr->hostid )
+  {
+    if ( permute )
+      addr += next_host ( cidr_ptr, sweep );
+    else
+      // cidr_ptr->hostid has bit 0=0. RANDOM() * (hostid + 1) / 2^32
+      // is always less then hostid + 1 (and no division is needed).
+      addr += ( ( uint64_t ) RANDOM() * ( cidr_ptr->hostid + 1 ) ) >> 32;
+  }
+
+  return addr;
+}
+
+/* Initializes a packet generator (on the thread which will use it).
+
+   'index' is the generator index, out of 'count': Each one has its own
+   random stream and its share of the CIDR sweeps and ports lists. */
+static void init_generator ( generator_T *g, config_options_T *co,
+                             const struct cidr *cidr, const struct cidr *source,
+                             unsigned int index, unsigned int count )
+{
+  g->co = co;
+  g->cidr = cidr;
+  g->source = source;
+
+  // SRANDOM is here because each generator must have its own
+  // random stream.
+  SRANDOM ( co->seed, index );
+
+  if ( co->permute && cidr->hostid )
+    init_sweep ( cidr, &g->sweep, index, count );
+
+  if ( co->permute && source->hostid )
+    init_sweep ( source, &g->source_sweep, index, count );
+
+  init_ports ( co, index, count );
+
+  // Initialize indices used for IPPROTO_T50 shuffling.
+  build_proto_indices();
+
+  /* Preallocate packet buffer. */
+  packet_get ( &g->buffer, INITIAL_PACKET_SIZE );
+  init_templates();
+
+  /* Selects the initial protocol. */
+  g->run = 0;
+  if ( co->ip.protocol != IPPROTO_T50 )
+    g->ptbl = select_protocol ( co, &g->proto );
+  else
+  {
+    g->proto = co->ip.protocol;
+    shuffle ( indices, number_of_modules );   // do initial shuffle.
+                                              // this maybe NOT be used afterwards.
+    g->ptbl = &mod_table[get_proto_index ( co )];
+  }
+}
+
+static void destroy_generator ( generator_T *g )
+{
+  destroy_ports();
+  destroy_templates();
+  packet_put ( &g->buffer );
+}
+
+/* Gets the addresses and ports of the next packet. */
+static void next_packet_vars ( generator_T *g, packet_vars_T *v )
+{
+  config_options_T *co = g->co;
+
+  /* Set the destination IP address to RANDOM IP address. */
+  if ( co->targets )
+    v->daddr = htonl ( next_target() );
+  else
+    v->daddr = htonl ( get_host ( g->cidr, &g->sweep, co->permute ) );
+
+  /* And the source address, if it comes from a range or a pool. */
+  if ( co->sources )
+    v->saddr = htonl ( next_source() );
+  else if ( g->source->hostid )
+    v->saddr = htonl ( get_host ( g->source, &g->source_sweep, co->permute ) );
+  else
+    v->saddr = co->ip.saddr;
+
+  /* Ports from the lists, if any. */
+  v->source = co->sports ? next_sport() : co->source;
+  v->dest = co->dports ? next_dport() : co->dest;
+}
+
+/* Accounts 'n' packets of the current protocol and, on T50 mode, gets
+   the next one at the end of its run. */
+static inline void next_protocol ( generator_T *g, uint32_t n )
+{
+  if ( g->proto == IPPROTO_T50 && ( g->run += n ) >= g->co->proto_run )
+  {
+    g->run = 0;
+    g->ptbl = &mod_table[get_proto_index ( g->co )];
+  }
+}
+
+/* Builds the next packet on the buffer 'pb'.
+   Returns the module used. */
+static modules_table_T *build_packet ( generator_T *g, packet_buffer_T *pb, size_t *size )
+{
+  config_options_T *co = g->co;
+  modules_table_T  *ptbl = g->ptbl;
+  packet_vars_T    vars;
+
+  next_packet_vars ( g, &vars );
+  set_packet_vars ( co, &vars );
+
+  /* Finally, builds the packet from the module template or
+     calls the 'module' function to build it. */
+  co->ip.protocol = ptbl->protocol_id;
+  if ( ! build_from_template ( ptbl - mod_table, co, pb, size ) )
+    ptbl->func ( co, pb, size );
+
+  /* If protocol is 'T50', then get the next true protocol
+     (at the end of the run, with --proto-run). */
+  next_protocol ( g, 1 );
+
+  return ptbl;
+}
+
+/* Builds up to 'count' packets (BUILD_BATCH, at most) of the same
+   protocol on the buffers 'pbs', with the batch function of the module,
+   if it has one (and no template).
+   Returns the number of packets built; The module used is stored on
+   'ptbl' and their addresses and ports, on 'vars'. */
+static unsigned int build_batch ( generator_T *g, packet_vars_T *vars,
+                                  packet_buffer_T *pbs, size_t *sizes,
+                                  unsigned int count, modules_table_T **ptbl )
+{
+  config_options_T *co = g->co;
+  unsigned int     i;
+
+  *ptbl = g->ptbl;
+
+  /* NOTE: On T50 mode a batch ends with the protocol run. */
+  if ( g->proto == IPPROTO_T50 && count > co->proto_run - g->run )
+    count = co->proto_run - g->run;
+
+  if ( count == 1 )
+  {
+    build_packet ( g, pbs, sizes );
+
+    vars->daddr = co->ip.daddr;
+    vars->saddr = co->ip.saddr;
+    vars->source = co->source;
+    vars->dest = co->dest;
+    return 1;
+  }
+
+  if ( count > BUILD_BATCH )
+    count = BUILD_BATCH;
+
+  i = 0;
+  while ( i < count )
+    next_packet_vars ( g, &vars[i++] );
+
+  co->ip.protocol = ( *ptbl )->protocol_id;
+
+  /* The first packet tells if there is a template. */
+  set_packet_vars ( co, &vars[0] );
+  if ( build_from_template ( *ptbl - mod_table, co, &pbs[0], &sizes[0] ) )
+  {
+    i = 1;
+    while ( i < count )
+    {
+      set_packet_vars ( co, &vars[i] );
+      build_from_template ( *ptbl - mod_table, co, &pbs[i], &sizes[i] );
+      i++;
+    }
+  }
+  else if ( ( *ptbl )->batch_func )
+    ( *ptbl )->batch_func ( co, vars, pbs, sizes, count );
+  else
+  {
+    i = 0;
+    while ( i < count )
+    {
+      set_packet_vars ( co, &vars[i] );
+      ( *ptbl )->func ( co, &pbs[i], &sizes[i] );
+      i++;
+    }
+  }
+
+  next_protocol ( g, count );
+
+  return count;
+}
+
+/* The main loop. */
+static void *worker ( void *arg )
+{
+  worker_T         *w = arg;
+  config_options_T *co = &w->co;
+  generator_T      g;
+  modules_table_T  *ptbl;
+  packet_buffer_T  tx, *pb;
+
+  worker_id = w->id;
+  tx_stats = &w->stats;
+
+  /* Pin the worker BEFORE allocating its memory. */
+  if ( w->cpu >= 0 )
+  {
+    cpu_set_t set;
+
+    CPU_ZERO ( &set );
+    CPU_SET ( w->cpu, &set );
+
+    if ( pthread_setaffinity_np ( pthread_self(), sizeof set, &set ) )
+      fatal_error ( "Cannot pin worker #%u to CPU %d.", w->id, w->cpu );
+  }
+
+  /* Room for the transmit batch and the packet being built
+     (or the batch of packets, for the corpus). */
+  init_packet_arena ( co->batch + 1 + ( co->pregen ? BUILD_BATCH : 0 ) );
+
+  if ( co->pipeline )
+  {
+    run_pipeline ( w );
+    destroy_packet_arena();
+    return NULL;
+  }
+
+  if ( co->pregen )
+  {
+    run_corpus ( w );
+    destroy_packet_arena();
+    return NULL;
+  }
+
+  init_generator ( &g, co, w->cidr, w->source, w->id, num_workers );
+
+  create_socket ( co );
+
+  init_pacing ( co );
+
+  // OBS: flood means non stop injection.
+  //      threshold is the number of packets to inject.
+  while ( co->flood || co->threshold )
+  {
+    /* Will hold the actual packet size after module function call. */
+    size_t size;
+    void   *slot;
+
+    /* Build the packet straight into the transmit slot, if there is one. */
+    pb = &g.buffer;
+    if ( ( slot = get_packet_slot ( &size ) ) != NULL )
+    {
+      packet_wrap ( &tx, slot, size );
+      pb = &tx;
+    }
+
+    ptbl = build_packet ( &g, pb, &size );
+
+    /* Wait for our turn, if the rate is limited. */
+    pace ( size );
+
+    /* Try to send the packet. */
+    if ( ! send_packet ( pb->data, size, co ) )
+#ifndef NDEBUG
+      error ( "Packet for protocol %s (%zu bytes long) not sent", ptbl->name, size );
+
+    /* continue trying to send other packets on debug mode! */
+#else
+      fatal_error ( "Unspecified error sending a packet" );
+#endif
+
+    /* Decrement the threshold only if not flooding! */
+    if ( !co->flood )
+      co->threshold--;
+  }
+
+  /* Send what is left on the transmit batch. */
+  if ( ! flush_packets() )
+#ifndef NDEBUG
+    error ( "Last batch of packets not sent" );
+#else
+    fatal_error ( "Unspecified error sending a packet" );
+#endif
+
+  close_socket();
+  destroy_generator ( &g );
+  destroy_packet_arena();
+
+  return NULL;
+}
+
+/* --pregen: Builds the worker share of the corpus, then sends it over
+   and over (the modules aren't called anymore). */
+static void run_corpus ( worker_T *w )
+{
+  config_options_T *co = &w->co;
+  generator_T      g;
+  struct timespec  now;
+  modules_table_T  *ptbl;
+  packet_buffer_T  pbs[BUILD_BATCH];
+  packet_vars_T    vars[BUILD_BATCH];
+  size_t           sizes[BUILD_BATCH];
+  const void       *buffer;
+  uint32_t         count, i, n, k;
+  size_t           size;
+  _Bool            huge;
+
+  count = co->pregen / num_workers + ( w->id < co->pregen % num_workers );
+
+  init_generator ( &g, co, w->cidr, w->source, w->id, num_workers );
+
+  corpus_create ( count );
+
+  /* The packets are built in batches, on arena buffers. */
+  k = 0;
+  while ( k < BUILD_BATCH )
+    packet_get ( &pbs[k++], INITIAL_PACKET_SIZE );
+
+  i = 0;
+  while ( i < count )
+  {
+    n = build_batch ( &g, vars, pbs, sizes, count - i, &ptbl );
+
+    k = 0;
+    while ( k < n )
+    {
+      corpus_add ( pbs[k].data, sizes[k] );
+      k++;
+    }
+
+    i += n;
+  }
+
+  k = 0;
+  while ( k < BUILD_BATCH )
+    packet_put ( &pbs[k++] );
+
+  huge = corpus_seal ( &size );
+  destroy_generator ( &g );
+
+  if ( !co->quiet )
+    printf ( INFO "Worker #%u: %u packets pre-generated (%zu bytes, on %s).\n",
+             w->id, count, size, huge ? "hugepages" : "normal pages" );
+
+  create_socket ( co );
+
+  init_pacing ( co );
+
+  /* Wait for the other workers. The last one to get here takes the time. */
+  if ( pthread_barrier_wait ( &pregen_barrier ) == PTHREAD_BARRIER_SERIAL_THREAD )
+  {
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    __atomic_store_n ( &pregen_time,
+                       ( uint64_t ) ( now.tv_sec - pregen_start.tv_sec ) * 1000000000ULL +
+                       now.tv_nsec - pregen_start.tv_nsec,
+                       __ATOMIC_RELAXED );
+  }
+
+  while ( co->flood || co->threshold )
+  {
+    buffer = corpus_next ( &size );
+
+    /* Raw sockets need the destination address. */
+    co->ip.daddr = ( ( const struct iphdr * ) buffer )->daddr;
+
+    /* Wait for our turn, if the rate is limited. */
+    pace ( size );
+
+    if ( ! send_packet ( buffer, size, co ) )
+#ifndef NDEBUG
+      error ( "Pre-generated packet (%zu bytes long) not sent", size );
+#else
+      fatal_error ( "Unspecified error sending a packet" );
+#endif
+
+    if ( !co->flood )
+      co->threshold--;
+  }
+
+  /* Send what is left on the transmit batch. */
+  if ( ! flush_packets() )
+#ifndef NDEBUG
+    error ( "Last batch of packets not sent" );
+#else
+    fatal_error ( "Unspecified error sending a packet" );
+#endif
+
+  close_socket();
+  corpus_destroy();
+}
+
+/* Pipeline builder: Builds its share of the worker packets straight into
+   the slots of its ring. */
+static void *builder ( void *arg )
+{
+  builder_T        *b = arg;
+  config_options_T *co = &b->co;
+  ring_T           *ring = b->ring;
+  generator_T      g;
+  modules_table_T  *ptbl;
+  ring_slot_T      *slot;
+  packet_buffer_T  pbs[BUILD_BATCH];
+  packet_vars_T    vars[BUILD_BATCH];
+  size_t           sizes[BUILD_BATCH];
+  uint32_t         n, k;
+
+  worker_id = b->worker->id;
+
+  /* Builders run anywhere (not on the CPU of the sender). */
+  pthread_setaffinity_np ( pthread_self(), sizeof allowed_cpus, &allowed_cpus );
+
+  /* NOTE: Packets are built on the ring slots. */
+  init_packet_arena ( 1 );
+
+  init_generator ( &g, co, b->worker->cidr, b->worker->source, b->id, num_workers * co->builders );
+
+  while ( co->flood || co->threshold )
+  {
+    /* Wait for the sender, if the ring is full. */
+    n = ring_wait ( ring );
+
+    if ( n > BUILD_BATCH )
+      n = BUILD_BATCH;
+
+    if ( !co->flood && n > ( uint32_t ) co->threshold )
+      n = co->threshold;
+
+    k = 0;
+    while ( k < n )
+    {
+      slot = ring_free_slot ( ring, k );
+      packet_wrap ( &pbs[k++], slot->data, ring->slot_size );
+    }
+
+    n = build_batch ( &g, vars, pbs, sizes, n, &ptbl );
+
+    /* The sender needs the address (and port) to send the packets. */
+    k = 0;
+    while ( k < n )
+    {
+      slot = ring_free_slot ( ring, k );
+      slot->size = sizes[k];
+      slot->daddr = vars[k].daddr;
+      slot->dest = vars[k].dest;
+      slot->module = ptbl - mod_table;
+      k++;
+    }
+
+    ring_commit ( ring, n );
+
+    if ( !co->flood )
+      co->threshold -= n;
+  }
+
+  ring_close ( ring );
+  destroy_generator ( &g );
+  destroy_packet_arena();
+
+  return NULL;
+}
+
+/* Pipeline sender: Creates the worker builders and sends the packets
+   from their rings, in bursts, until all of them are closed. */
+static void run_pipeline ( worker_T *w )
+{
+  config_options_T *co = &w->co;
+  ring_T           *live[BUILDERS_MAX];
+  ring_slot_T      *slot;
+  sigset_t         sigset, oldset;
+  unsigned int     i, active;
+  uint32_t         n, k;
+  _Bool            closed, idle;
+
+  if ( posix_memalign ( ( void ** ) &w->builders, CACHE_LINE_SIZE, co->builders * sizeof ( builder_T ) ) )
+    fatal_error ( "Cannot allocate builders." );
+
+  /* Split the worker packets between its builders. */
+  i = 0;
+  while ( i < co->builders )
+  {
+    builder_T *b = &w->builders[i];
+
+    memset ( b, 0, sizeof ( builder_T ) );
+    b->id = w->id * co->builders + i;
+    b->worker = w;
+    b->co = *co;
+    b->co.threshold = co->threshold / co->builders + ( i < co->threshold % co->builders );
+    b->ring = live[i] = ring_create ( co->ring_depth, co->ring_slot );
+
+    i++;
+  }
+
+  /* From now on, the statistics may be read. */
+  __atomic_store_n ( &w->num_builders, co->builders, __ATOMIC_RELEASE );
+
+  create_socket ( co );
+
+  init_pacing ( co );
+
+  /* Signals are handled only by the main thread. */
+  sigfillset ( &sigset );
+  pthread_sigmask ( SIG_BLOCK, &sigset, &oldset );
+
+  i = 0;
+  while ( i < co->builders )
+  {
+    if ( pthread_create ( &w->builders[i].tid, NULL, builder, &w->builders[i] ) )
+      fatal_error ( "Cannot create builder #%u of worker #%u.", i, w->id );
+
+    i++;
+  }
+
+  pthread_sigmask ( SIG_SETMASK, &oldset, NULL );
+
+  /* Round robin on the rings still open. */
+  active = co->builders;
+  idle = 1;
+  i = 0;
+  while ( active )
+  {
+    ring_T *ring = live[i];
+
+    /* NOTE: Read before polling. Closed and empty means done. */
+    closed = ring_closed ( ring );
+
+    if ( ( n = ring_poll ( ring ) ) != 0 )
+    {
+      if ( n > PIPELINE_BURST )
+        n = PIPELINE_BURST;
+
+      k = 0;
+      while ( k < n )
+      {
+        slot = ring_slot ( ring, k++ );
+
+        co->ip.daddr = slot->daddr;
+        co->dest = slot->dest;
+
+        /* Wait for our turn, if the rate is limited. */
+        pace ( slot->size );
+
+        if ( ! send_packet ( slot->data, slot->size, co ) )
+#ifndef NDEBUG
+          error ( "Packet for protocol %s (%u bytes long) not sent", mod_table[slot->module].name, slot->size );
+#else
+          fatal_error ( "Unspecified error sending a packet" );
+#endif
+      }
+
+      /* NOTE: The backends copy the packet (or have sent it already). */
+      ring_release ( ring, n );
+      idle = 0;
+    }
+    else if ( closed )
+    {
+      live[i] = live[--active];
+      if ( i < active )
+        continue;
+    }
+
+    /* All rings empty? Let the builders run. */
+    if ( ++i >= active )
+    {
+      if ( idle )
+        sched_yield();
+
+      idle = 1;
+      i = 0;
+    }
+  }
+
+  /* Send what is left on the transmit batch. */
+  if ( ! flush_packets() )
+#ifndef NDEBUG
+    error ( "Last batch of packets not sent" );
+#else
+    fatal_error ( "Unspecified error sending a packet" );
+#endif
+
+  i = 0;
+  while ( i < co->builders )
+    pthread_join ( w->builders[i++].tid, NULL );
+
+  close_socket();
+}
+
+/* Selects the initial protocol based on the configuration. */
+static modules_table_T *select_protocol ( const config_options_T *restrict co, int *restrict proto )
+{
+  modules_table_T *ptbl;
+
+  ptbl = mod_table;
+
+  // FIXME: Of course this is a 'hack'. Maybe I should divise something more portable here.
+  if ( ( *proto = co->ip.protocol ) != IPPROTO_T50 )
+    ptbl += co->ip.protoname;
+
+  return ptbl;
+}
+
+/**
+ * Checks the syntax of a CPU list (--cpus).
+ */
+_Bool check_cpu_list ( const char *s )
+{
+  cpu_set_t set;
+
+  return parse_cpu_list ( s, &set );
+}
+
+/* Parses a CPU list, as in "0-3,8,10-11" (same format used by sysfs). */
+static int parse_cpu_list ( const char *s, cpu_set_t *set )
+{
+  unsigned long a, b;
+  char *p;
+
+  CPU_ZERO ( set );
+
+  while ( *s && *s != '\n' )
+  {
+    if ( ! isdigit ( *s ) )
+      return 0;
+
+    b = a = strtoul ( s, &p, 10 );
+
+    if ( *p == '-' )
+    {
+      s = p + 1;
+      if ( ! isdigit ( *s ) )
+        return 0;
+
+      b = strtoul ( s, &p, 10 );
+    }
+
+    if ( a > b || b >= CPU_SETSIZE )
+      return 0;
+
+    while ( a <= b )
+      CPU_SET ( a++, set );
+
+    if ( *p == ',' )
+      p++;
+    else if ( *p && *p != '\n' )
+      return 0;
+
+    s = p;
+  }
+
+  return CPU_COUNT ( set ) > 0;
+}
+
+/* Gets the CPUs on the same NUMA node of the interface (through sysfs).
+   Returns false if the node is unknown. */
+static int get_iface_cpus ( const char *iface, cpu_set_t *set )
+{
+  char path[128], buffer[1024];
+  FILE *f;
+  int node;
+
+  snprintf ( path, sizeof path, "/sys/class/net/%s/device/numa_node", iface );
+  if ( ! ( f = fopen ( path, "r" ) ) )
+    return 0;
+
+  if ( fscanf ( f, "%d", &node ) != 1 )
+    node = -1;
+  fclose ( f );
+
+  /* -1 means no NUMA information (or a virtual interface). */
+  if ( node < 0 )
+    return 0;
+
+  snprintf ( path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node );
+  if ( ! ( f = fopen ( path, "r" ) ) )
+    return 0;
+
+  if ( ! fgets ( buffer, sizeof buffer, f ) )
+    *buffer = '\0';
+  fclose ( f );
+
+  return parse_cpu_list ( buffer, set );
+}
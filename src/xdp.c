@@ -0,0 +1,439 @@
+/* vim: set ts=2 et sw=2 : */
+/** @file xdp.c */
+/*
+ *  T50 - Experimental Mixed Packet Injector
+ *
+ *  Copyright (C) 2010 - 2019 - T50 developers
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* AF_XDP (XSK) backend.
+
+   Packets are built directly on the frames of an UMEM area, registered
+   with an AF_XDP socket, and their descriptors are placed on the TX ring.
+   Transmitted frames come back through the completion ring and are reused.
+
+   No XDP program is needed to transmit. Zero-copy mode is tried first,
+   falling back to copy mode (generic XDP, veth, ...) if the driver
+   doesn't support it.
+
+   There is no kernel network stack here: The ethernet header is prebuilt
+   on every frame, using the interface MAC address as source and --dmac
+   as destination.
+
+   Each worker uses its own socket, bound to the queue with the same index
+   as the worker. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/ethernet.h>
+#include <linux/if_xdp.h>
+#include <linux/ip.h>
+#include <t50_defines.h>
+#include <t50_errors.h>
+#include <t50_cksum.h>
+#include <t50_netio.h>
+#include <t50_backends.h>
+#include <t50_workers.h>
+
+#ifndef AF_XDP
+  #define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+  #define SOL_XDP 283
+#endif
+
+/* UMEM geometry: 4096 frames of 2 KiB.
+   TX and completion rings have the same number of entries, so they
+   never overflow. */
+#define XDP_FRAME_SIZE    TX_SLOT_SIZE
+#define XDP_NUM_FRAMES    4096
+#define XDP_RING_SIZE     XDP_NUM_FRAMES
+#define XDP_FILL_SIZE     64      /* Not used, but required by the kernel. */
+
+/* Maximum time waiting for the frames to come back, on flush (ms). */
+#define XDP_FLUSH_TIMEOUT 1000
+
+/* The frame starts 2 bytes after the chunk start, so the IP header
+   (after the 14 bytes ethernet header) is 4 bytes aligned. */
+#define XDP_FRAME_OFFSET  2
+#define XDP_DATA_OFFSET   ( XDP_FRAME_OFFSET + ETH_HLEN )
+
+/* Producer/consumer ring, shared with the kernel. */
+struct xsk_ring
+{
+  uint32_t *producer;
+  uint32_t *consumer;
+  uint32_t *flags;
+  void     *ring;
+  void     *map;
+  size_t    map_len;
+  uint32_t  mask;
+  uint32_t  cached;     /* Local copy of our index (producer or consumer). */
+};
+
+/* NOTE: Every worker has its own socket and rings. */
+static _Thread_local int               fd = -1;
+static _Thread_local void             *umem = MAP_FAILED;
+static _Thread_local struct xsk_ring   tx, cq, fq;
+static _Thread_local uint64_t         *free_frames = NULL;    /* Stack of free frames. */
+static _Thread_local uint16_t         *frame_len = NULL;      /* Packet size, on each frame. */
+static _Thread_local unsigned int      free_nr = 0;
+static _Thread_local unsigned int      kick_every = 1;
+static _Thread_local unsigned int      pending = 0;           /* Descriptors not submitted yet. */
+
+static void  map_ring ( struct xsk_ring *, struct xdp_ring_offset *, uint32_t, size_t, uint64_t );
+static void  unmap_ring ( struct xsk_ring * );
+static int   xdp_bind ( int, uint32_t );
+static void  xdp_reclaim ( void );
+static int   xdp_submit ( void );
+static void  xdp_wait_frame ( void );
+
+/* Creates the AF_XDP socket, registers the UMEM and maps the rings. */
+void xdp_create ( const config_options_T * const restrict co )
+{
+  struct xdp_umem_reg reg;
+  struct xdp_mmap_offsets off;
+  struct ether_header eth;
+  socklen_t len;
+  uint32_t n;
+  unsigned int i;
+  int ifindex;
+
+  ifindex = get_iface_index ( co->iface );
+
+  if ( ( fd = socket ( AF_XDP, SOCK_RAW, 0 ) ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot open AF_XDP socket: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot open AF_XDP socket" );
+#endif
+  }
+
+  if ( ( umem = mmap ( NULL, ( size_t ) XDP_NUM_FRAMES * XDP_FRAME_SIZE,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+                       -1, 0 ) ) == MAP_FAILED )
+    fatal_error ( "Cannot allocate UMEM area." );
+
+  memset ( &reg, 0, sizeof reg );
+  reg.addr = ( uintptr_t ) umem;
+  reg.len = ( uint64_t ) XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+  reg.chunk_size = XDP_FRAME_SIZE;
+
+  if ( setsockopt ( fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof reg ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot register UMEM: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot register UMEM" );
+#endif
+  }
+
+  n = XDP_FILL_SIZE;
+  if ( setsockopt ( fd, SOL_XDP, XDP_UMEM_FILL_RING, &n, sizeof n ) == -1 )
+    goto rings_error;
+
+  n = XDP_RING_SIZE;
+  if ( setsockopt ( fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &n, sizeof n ) == -1 ||
+       setsockopt ( fd, SOL_XDP, XDP_TX_RING, &n, sizeof n ) == -1 )
+    goto rings_error;
+
+  len = sizeof off;
+  if ( getsockopt ( fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len ) == -1 )
+    goto rings_error;
+
+  map_ring ( &fq, &off.fr, XDP_FILL_SIZE, sizeof ( uint64_t ), XDP_UMEM_PGOFF_FILL_RING );
+  map_ring ( &cq, &off.cr, XDP_RING_SIZE, sizeof ( uint64_t ), XDP_UMEM_PGOFF_COMPLETION_RING );
+  map_ring ( &tx, &off.tx, XDP_RING_SIZE, sizeof ( struct xdp_desc ), XDP_PGOFF_TX_RING );
+
+  /* Our indexes start where the kernel ones are. */
+  tx.cached = *tx.producer;
+  cq.cached = *cq.consumer;
+
+  /* Try zero-copy first. */
+  if ( xdp_bind ( ifindex, XDP_ZEROCOPY ) == -1 &&
+       xdp_bind ( ifindex, XDP_COPY ) == -1 )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot bind AF_XDP socket to %s: \"%s\"", co->iface, strerror ( errno ) );
+#else
+    fatal_error ( "Cannot bind AF_XDP socket to %s", co->iface );
+#endif
+  }
+
+  /* Prebuild the ethernet header on every frame. All frames are free. */
+  memcpy ( eth.ether_dhost, co->dmac, ETH_ALEN );
+  get_iface_hwaddr ( co->iface, eth.ether_shost );
+  eth.ether_type = htons ( ETHERTYPE_IP );
+
+  if ( ! ( free_frames = malloc ( XDP_NUM_FRAMES * sizeof ( uint64_t ) ) ) ||
+       ! ( frame_len = malloc ( XDP_NUM_FRAMES * sizeof ( uint16_t ) ) ) )
+    fatal_error ( "Cannot allocate UMEM frames list." );
+
+  i = 0;
+  while ( i < XDP_NUM_FRAMES )
+  {
+    free_frames[i] = ( uint64_t ) i * XDP_FRAME_SIZE;
+    memcpy ( umem + free_frames[i] + XDP_FRAME_OFFSET, &eth, ETH_HLEN );
+    i++;
+  }
+  free_nr = XDP_NUM_FRAMES;
+
+  kick_every = co->batch;
+  if ( kick_every > XDP_RING_SIZE / 2 )
+    kick_every = XDP_RING_SIZE / 2;
+
+  pending = 0;
+  return;
+
+rings_error:
+#ifndef NDEBUG
+  fatal_error ( "Cannot setup AF_XDP rings: \"%s\"", strerror ( errno ) );
+#else
+  fatal_error ( "Cannot setup AF_XDP rings" );
+#endif
+}
+
+void xdp_close ( void )
+{
+  unmap_ring ( &tx );
+  unmap_ring ( &cq );
+  unmap_ring ( &fq );
+
+  if ( fd > 0 )
+  {
+    close ( fd );
+    fd = -1;
+  }
+
+  if ( umem != MAP_FAILED )
+  {
+    munmap ( umem, ( size_t ) XDP_NUM_FRAMES * XDP_FRAME_SIZE );
+    umem = MAP_FAILED;
+  }
+
+  SAFE_FREE ( free_frames );
+  SAFE_FREE ( frame_len );
+  free_nr = 0;
+}
+
+/* Gets the next free frame, waiting for completions if necessary. */
+void *xdp_get_slot ( size_t *size )
+{
+  if ( ! free_nr )
+    xdp_wait_frame();
+
+  *size = XDP_FRAME_SIZE - XDP_DATA_OFFSET;
+  return umem + free_frames[free_nr - 1] + XDP_DATA_OFFSET;
+}
+
+/* Places the frame descriptor on the TX ring. */
+int xdp_send ( const void * const buffer,
+               size_t size,
+               const config_options_T * const restrict co __attribute__((unused)) )
+{
+  struct xdp_desc *desc;
+  struct iphdr *ip;
+  uint64_t addr;
+  void *slot;
+
+  if ( ! free_nr )
+    xdp_wait_frame();
+
+  addr = free_frames[--free_nr];
+  slot = umem + addr + XDP_DATA_OFFSET;
+
+  /* Packet not built in place? Copy it! */
+  if ( buffer != slot )
+  {
+    if ( size > XDP_FRAME_SIZE - XDP_DATA_OFFSET )
+      fatal_error ( "Packet (%zu bytes) is too big for the transmit slot.", size );
+
+    memcpy ( slot, buffer, size );
+  }
+
+  /* There is no kernel IP layer here: The IP header checksum is ours. */
+  ip = slot;
+  ip->check = 0;
+  ip->check = cksum ( ip, ip->ihl * 4 );
+
+  desc = ( struct xdp_desc * ) tx.ring + ( tx.cached++ & tx.mask );
+  desc->addr = addr + XDP_FRAME_OFFSET;
+  desc->len = size + ETH_HLEN;
+  desc->options = 0;
+
+  /* Accounted when the frame comes back (completion ring). */
+  frame_len[addr / XDP_FRAME_SIZE] = size;
+
+  if ( ++pending < kick_every )
+    return 1;
+
+  return xdp_submit();
+}
+
+int xdp_flush ( void )
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+  struct timespec t0, t1;
+
+  if ( pending && !xdp_submit() )
+    return 0;
+
+  clock_gettime ( CLOCK_MONOTONIC, &t0 );
+
+  /* Wait for all frames to come back, before closing the socket.
+     NOTE: The driver may never give them back (link down, queue
+           detached, ...): Don't wait forever. */
+  while ( free_nr < XDP_NUM_FRAMES )
+  {
+    sendto ( fd, NULL, 0, MSG_DONTWAIT, NULL, 0 );
+    poll ( &pfd, 1, 1 );
+    xdp_reclaim();
+
+    clock_gettime ( CLOCK_MONOTONIC, &t1 );
+    if ( ( t1.tv_sec - t0.tv_sec ) * 1000 + ( t1.tv_nsec - t0.tv_nsec ) / 1000000 >= XDP_FLUSH_TIMEOUT )
+    {
+      /* The frames still out weren't sent (as far as we know). */
+      tx_stats->packets_dropped += XDP_NUM_FRAMES - free_nr;
+      break;
+    }
+  }
+
+  return 1;
+}
+
+/* Makes the pending descriptors visible to the kernel and kicks it. */
+static int xdp_submit ( void )
+{
+  __atomic_store_n ( tx.producer, tx.cached, __ATOMIC_RELEASE );
+
+  /* NOTE: ENOBUFS, EAGAIN and EBUSY mean the descriptors will be
+           consumed later, on the next kick. They are accounted
+           only when they come back (xdp_reclaim). */
+  if ( sendto ( fd, NULL, 0, MSG_DONTWAIT, NULL, 0 ) == -1 )
+    switch ( errno )
+    {
+      case EINTR:
+      case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+      case EWOULDBLOCK:
+#endif
+      case EBUSY:
+      case ENOBUFS:
+        break;
+
+      default:
+        return 0;
+    }
+
+  pending = 0;
+
+  xdp_reclaim();
+
+  return 1;
+}
+
+/* Gets back the frames already transmitted (completion ring),
+   accounting them as sent. */
+static void xdp_reclaim ( void )
+{
+  uint64_t addr;
+  uint32_t prod;
+
+  prod = __atomic_load_n ( cq.producer, __ATOMIC_ACQUIRE );
+  if ( prod == cq.cached )
+    return;
+
+  while ( cq.cached != prod )
+  {
+    /* Completions return the descriptor address. Get the frame back. */
+    addr = ( ( uint64_t * ) cq.ring )[cq.cached++ & cq.mask] & ~( uint64_t ) ( XDP_FRAME_SIZE - 1 );
+    free_frames[free_nr++] = addr;
+
+    tx_stats->packets_sent++;
+    tx_stats->bytes_sent += frame_len[addr / XDP_FRAME_SIZE];
+  }
+
+  __atomic_store_n ( cq.consumer, cq.cached, __ATOMIC_RELEASE );
+}
+
+/* All frames are in use: Submit what we have and wait. */
+static void xdp_wait_frame ( void )
+{
+  xdp_reclaim();
+  while ( ! free_nr )
+  {
+    if ( pending )
+      xdp_submit();
+    else
+      sendto ( fd, NULL, 0, MSG_DONTWAIT, NULL, 0 );
+
+    wait_for_io ( fd, POLLOUT );
+
+    xdp_reclaim();
+  }
+}
+
+static int xdp_bind ( int ifindex, uint32_t mode )
+{
+  struct sockaddr_xdp sxdp;
+
+  memset ( &sxdp, 0, sizeof sxdp );
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = ifindex;
+  sxdp.sxdp_queue_id = worker_id;     /* One TX queue per worker. */
+  sxdp.sxdp_flags = mode;
+
+  return bind ( fd, ( struct sockaddr * ) &sxdp, sizeof sxdp );
+}
+
+static void map_ring ( struct xsk_ring *r, struct xdp_ring_offset *off, uint32_t entries, size_t entry_size, uint64_t pgoff )
+{
+  r->map_len = off->desc + entries * entry_size;
+  if ( ( r->map = mmap ( NULL, r->map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, pgoff ) ) == MAP_FAILED )
+  {
+#ifndef NDEBUG
+    fatal_error ( "Cannot map AF_XDP ring: \"%s\"", strerror ( errno ) );
+#else
+    fatal_error ( "Cannot map AF_XDP ring" );
+#endif
+  }
+
+  r->producer = r->map + off->producer;
+  r->consumer = r->map + off->consumer;
+  r->flags = r->map + off->flags;
+  r->ring = r->map + off->desc;
+  r->mask = entries - 1;
+}
+
+static void unmap_ring ( struct xsk_ring *r )
+{
+  if ( r->map && r->map != MAP_FAILED )
+    munmap ( r->map, r->map_len );
+
+  r->map = NULL;
+}